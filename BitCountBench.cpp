@@ -0,0 +1,122 @@
+/*
+  Developed by Sandeep Sharma with contributions from James E. T. Smith and Adam A. Holmes, 2017
+  Copyright (c) 2017, Sandeep Sharma
+
+  This file is part of DICE.
+
+  This program is free software: you can redistribute it and/or modify it under the terms
+  of the GNU General Public License as published by the Free Software Foundation,
+  either version 3 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with this program.
+  If not, see <http://www.gnu.org/licenses/>.
+*/
+//Microbenchmark of the bit kernels used by Hij, HmultDirect and the RDMs.
+//Build with "make bitbench" and compare the timings of a USE_POPCNT=yes and
+//a USE_POPCNT=no build for the Determinant kernels.
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "Determinants.h"
+
+using namespace std;
+
+int HalfDet::norbs = 1;
+int Determinant::norbs = 1;
+int Determinant::EffDetLen = 1;
+char Determinant::Trev = 0;
+hashType Determinant::HashType = LEXICALHASH;
+Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic> Determinant::LexicalOrder;
+
+template<typename F>
+double nsPerCall(size_t ncalls, F f) {
+  auto start = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::nano>(end-start).count()/ncalls;
+}
+
+int main(int argc, char* argv[]) {
+  int norbs = argc > 1 ? atoi(argv[1]) : 100;  //spatial orbitals
+  int nelec = argc > 2 ? atoi(argv[2]) : 30;
+  int ndets = 4096, nrep = 2000;
+  Determinant::norbs = 2*norbs;
+  HalfDet::norbs = 2*norbs;
+  Determinant::EffDetLen = 2*norbs/64+1;
+  if (Determinant::EffDetLen > DetLen) {
+    cout << "norbs too large for DETLEN="<<DetLen<<endl;
+    exit(0);
+  }
+
+  //random determinants with nelec electrons
+  srand(7);
+  vector<Determinant> dets(ndets);
+  for (int d=0; d<ndets; d++)
+    for (int n=0; n<nelec; ) {
+      int orb = rand()%(2*norbs);
+      if (!dets[d].getocc(orb)) {dets[d].setocc(orb, true); n++;}
+    }
+  vector<long> words(ndets*DetLen);
+  for (int d=0; d<ndets; d++)
+    for (int i=0; i<DetLen; i++) words[d*DetLen+i] = dets[d].repr[i];
+
+  size_t ncalls = (size_t)nrep*ndets;
+  long sum = 0;
+
+  cout << "norbs "<<norbs<<"  nelec "<<nelec<<"  DETLEN "<<DetLen<<endl;
+#ifdef __POPCNT__
+  cout << "BitCount uses the popcnt instruction"<<endl;
+#else
+  cout << "BitCount uses the portable SWAR code"<<endl;
+#endif
+  cout << "kernel                   ns/call"<<endl;
+
+  double t = nsPerCall(ncalls*DetLen, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (size_t w=0; w<words.size(); w++) sum += BitCountSWAR(words[w]^r);
+    });
+  cout << "BitCountSWAR             "<<t<<endl;
+  t = nsPerCall(ncalls*DetLen, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (size_t w=0; w<words.size(); w++) sum += BitCount(words[w]^r);
+    });
+  cout << "BitCount                 "<<t<<endl;
+  t = nsPerCall(ncalls, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (int d=0; d<ndets; d++) sum += dets[d].ExcitationDistance(dets[(d+r)%ndets]);
+    });
+  cout << "ExcitationDistance       "<<t<<endl;
+  t = nsPerCall(ncalls, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (int d=0; d<ndets; d++) sum += dets[d].connected1Alpha1Beta(dets[(d+r)%ndets]);
+    });
+  cout << "connected1Alpha1Beta     "<<t<<endl;
+  t = nsPerCall(ncalls, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (int d=0; d<ndets; d++) sum += dets[d].Noccupied();
+    });
+  cout << "Noccupied                "<<t<<endl;
+  t = nsPerCall(ncalls, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (int d=0; d<ndets; d++) sum += dets[d].numUnpairedElectrons();
+    });
+  cout << "numUnpairedElectrons     "<<t<<endl;
+  double sgn = 1.0;
+  t = nsPerCall(ncalls, [&]() {
+      for (int r=0; r<nrep; r++)
+        for (int d=0; d<ndets; d++) {
+          int start = (d+r)%(2*norbs), end = (3*d+r)%(2*norbs);
+          dets[d].parity(min(start,end), max(start,end), sgn);
+        }
+    });
+  cout << "parity                   "<<t<<endl;
+
+  cout << "checksum "<<sum<<" "<<sgn<<endl;
+  return 0;
+}
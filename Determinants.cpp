@@ -125,9 +125,13 @@ void updateHijForTReversal(CItype& hij, Determinant& dj, Determinant& dk,
     Determinant detcpy = dk;
 
     detcpy.flipAlphaBeta();
-    if (!detcpy.connected(dj)) return;
+    Excitation ex;
+    getExcitation(dj, detcpy, ex);
+    if (ex.level > 2) return;
     double parity = dk.parityOfFlipAlphaBeta();
-    CItype hijCopy = Hij(dj, detcpy, I1, I2, coreE, orbDiff);
+    CItype hijCopy = ex.level == 0 ? Hij(dj, detcpy, I1, I2, coreE, orbDiff)
+                                   : Hij(detcpy, ex, I1, I2);
+    orbDiff = ex.orbDiff;
     hij = (hij + parity*Determinant::Trev*hijCopy)/pow(2.,0.5);
   }
   else if (Determinant::Trev != 0 && dj.hasUnpairedElectrons() &&
@@ -135,9 +139,13 @@ void updateHijForTReversal(CItype& hij, Determinant& dj, Determinant& dk,
     Determinant detcpy = dj;
 
     detcpy.flipAlphaBeta();
-    if (!detcpy.connected(dk)) return;
+    Excitation ex;
+    getExcitation(detcpy, dk, ex);
+    if (ex.level > 2) return;
     double parity = dj.parityOfFlipAlphaBeta();
-    CItype hijCopy = Hij(detcpy, dk, I1, I2, coreE, orbDiff);
+    CItype hijCopy = ex.level == 0 ? Hij(detcpy, dk, I1, I2, coreE, orbDiff)
+                                   : Hij(dk, ex, I1, I2);
+    orbDiff = ex.orbDiff;
     hij = (hij + parity*Determinant::Trev*hijCopy)/pow(2.,0.5);
   }
   else if (Determinant::Trev != 0 && dj.hasUnpairedElectrons()
@@ -145,9 +153,13 @@ void updateHijForTReversal(CItype& hij, Determinant& dj, Determinant& dk,
     Determinant detcpyk = dk;
 
     detcpyk.flipAlphaBeta();
-    if (!detcpyk.connected(dj)) return;
+    Excitation ex;
+    getExcitation(dj, detcpyk, ex);
+    if (ex.level > 2) return;
     double parityk = dk.parityOfFlipAlphaBeta();
-    CItype hijCopy1 = Hij(dj, detcpyk, I1, I2, coreE, orbDiff);
+    CItype hijCopy1 = ex.level == 0 ? Hij(dj, detcpyk, I1, I2, coreE, orbDiff)
+                                    : Hij(detcpyk, ex, I1, I2);
+    orbDiff = ex.orbDiff;
     CItype hijCopy2, hijCopy3;
     hij = hij + Determinant::Trev*parityk*hijCopy1;
 
@@ -156,17 +168,17 @@ void updateHijForTReversal(CItype& hij, Determinant& dj, Determinant& dk,
 
 
 //=============================================================================
-double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+double EnergyAfterExcitation(int* closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
 			     int i, int A, double Energyd) {
 	/*!
 	   Calculates the new energy of a determinant after single excitation.
-
-	   .. note:: Assumes that the spin of i and a orbitals is the same
+	   The cost is O(nclosed) through the Direct and Exchange matrices, and
+	   the spins of i and A can differ (spin-orbit singles).
 
 	   :Arguments:
 
-  	   vector<int>& closed:
-  	       Occupied orbitals in a vector.
+  	   int* closed:
+  	       Occupied orbitals in an array.
   	   int& nclosed:
   	       Number of occupied orbitals.
   	   oneInt& I1:
@@ -199,25 +211,25 @@ double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoI
     if (I == i) continue;
     E = E - I2.Direct(closed[I]/2, closed[i]/2) + I2.Direct(closed[I]/2, A/2);
     if ( (closed[I]%2) == (closed[i]%2) )
-      E = E + I2.Exchange(closed[I]/2, closed[i]/2) - I2.Exchange(closed[I]/2, A/2);
+      E = E + I2.Exchange(closed[I]/2, closed[i]/2);
+    if ( (closed[I]%2) == (A%2) )
+      E = E - I2.Exchange(closed[I]/2, A/2);
   }
   return E;
 }
 
-//Assumes that the spin of i and a orbitals is the same
-//and the spins of j and b orbitals is the same
 //=============================================================================
-double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+double EnergyAfterExcitation(int* closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
 			     int i, int A, int j, int B, double Energyd) {
 	/*!
 	   Calculates the new energy of a determinant after double excitation. i -> A and j -> B.
-
-	   .. note:: Assumes that the spin of each orbital pair (i-A and j-B) is the same.
+	   The cost is O(nclosed) through the Direct and Exchange matrices, and
+	   the spins of each orbital pair (i-A and j-B) can differ.
 
 	   :Arguments:
 
-  	   vector<int>& closed:
-  	       Occupied orbitals in a vector.
+  	   int* closed:
+  	       Occupied orbitals in an array.
   	   int& nclosed:
   	       Number of occupied orbitals.
   	   oneInt& I1:
@@ -253,19 +265,25 @@ double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoI
     if (I == i) continue;
     E = E - I2.Direct(closed[I]/2, closed[i]/2) + I2.Direct(closed[I]/2, A/2);
     if ( (closed[I]%2) == (closed[i]%2) )
-      E = E + I2.Exchange(closed[I]/2, closed[i]/2) - I2.Exchange(closed[I]/2, A/2);
+      E = E + I2.Exchange(closed[I]/2, closed[i]/2);
+    if ( (closed[I]%2) == (A%2) )
+      E = E - I2.Exchange(closed[I]/2, A/2);
   }
 
   for (int I=0; I<nclosed; I++) {
     if (I == i || I == j) continue;
     E = E - I2.Direct(closed[I]/2, closed[j]/2) + I2.Direct(closed[I]/2, B/2);
     if ( (closed[I]%2) == (closed[j]%2) )
-      E = E + I2.Exchange(closed[I]/2, closed[j]/2) - I2.Exchange(closed[I]/2, B/2);
+      E = E + I2.Exchange(closed[I]/2, closed[j]/2);
+    if ( (closed[I]%2) == (B%2) )
+      E = E - I2.Exchange(closed[I]/2, B/2);
   }
 
   E = E - I2.Direct(A/2, closed[j]/2) + I2.Direct(A/2, B/2);
-  if ( (closed[i]%2) == (closed[j]%2) )
-    E = E + I2.Exchange(A/2, closed[j]/2) - I2.Exchange(A/2, B/2);
+  if ( (A%2) == (closed[j]%2) )
+    E = E + I2.Exchange(A/2, closed[j]/2);
+  if ( (A%2) == (B%2) )
+    E = E - I2.Exchange(A/2, B/2);
 
 
   return E;
@@ -479,10 +497,16 @@ CItype Hij_1Excite(int a, int i, oneInt& I1, twoInt& I2, int* closed, int& nclos
   double sgn=1.0;
 
   CItype energy = I1(a,i);
+  bool sameSpin = a%2 == i%2;
+  int A = a/2, I = i/2;
   for (int j=0; j<nclosed; j++) {
     if (closed[j]>min(i,a)&& closed[j] <max(i,a))
       sgn*=-1.;
-    energy += (I2(a,i,closed[j],closed[j]) - I2(a,closed[j],closed[j], i));
+    //(ai|jj) - (aj|ji) on the spatial orbitals
+    if (!sameSpin) continue;
+    int J = closed[j]/2;
+    energy += I2.spatial(A, I, J, J);
+    if (closed[j]%2 == a%2) energy -= I2.spatial(A, J, J, I);
   }
 
   return energy*sgn;
@@ -508,21 +532,46 @@ CItype Determinant::Hij_1Excite(int& a, int& i, oneInt&I1, twoInt& I2) {
   */
   double sgn = 1.0;
   parity(min(a,i), max(a,i), sgn);
+  return sgn*Hij_1ExciteNoParity(a, i, I1, I2);
+}
+
+
+//=============================================================================
+CItype Determinant::Hij_1ExciteNoParity(int a, int i, oneInt&I1, twoInt& I2) {
+  /*!
+  The hamiltonian matrix element of the single excitation :math:`\Gamma = a^\dagger_a a_i`
+  without its parity, for callers that already have the sign (see getExcitation).
+
+  :Arguments:
 
+      int a:
+          Creation operator index.
+      int i:
+          Destruction operator index.
+      oneInt& I1:
+          One body integrals.
+      twoInt& I2:
+          Two body integrals.
+
+  */
   CItype energy = I1(a,i);
+  //(ai|jj) - (aj|ji) vanishes unless a and i have the same spin, and only the
+  //occupied j of that spin contribute to the exchange
+  if (a%2 != i%2) return energy;
+  int A = a/2, I = i/2;
   long one = 1;
-  for (int I=0; I<EffDetLen; I++) {
+  for (int w=0; w<EffDetLen; w++) {
 
-    long reprBit = repr[I];
+    long reprBit = repr[w];
     while (reprBit != 0) {
       int pos = __builtin_ffsl(reprBit);
-      int j = I*64+pos-1;
-      energy += (I2(a,i,j,j) - I2(a,j,j,i));
+      int j = w*64+pos-1, J = j/2;
+      energy += I2.spatial(A, I, J, J);
+      if (j%2 == a%2) energy -= I2.spatial(A, J, J, I);
       reprBit &= ~(one<<(pos-1));
     }
 
   }
-  energy *= sgn;
   return energy;
 }
 
@@ -541,44 +590,13 @@ void getOrbDiff(Determinant& bra, Determinant &ket, size_t &orbDiff) {
       size_t& orbDiff:
           Number of orbitals with differing occupations. Changed in this function.
   */
-  int cre[2],des[2],ncre=0,ndes=0; long u,b,k,one=1;
-  cre[0]=-1; cre[1]=-1; des[0]=-1; des[1]=-1;
-
-  for (int i=0; i<Determinant::EffDetLen; i++) {
-    u = bra.repr[i] ^ ket.repr[i];
-    b = u & bra.repr[i]; //the cre bits
-    k = u & ket.repr[i]; //the des bits
-
-    while(b != 0) {
-      int pos = __builtin_ffsl(b);
-      cre[ncre] = pos-1+i*64;
-      ncre++;
-      b &= ~(one<<(pos-1));
-    }
-    while(k != 0) {
-      int pos = __builtin_ffsl(k);
-      des[ndes] = pos-1+i*64;
-      ndes++;
-      k &= ~(one<<(pos-1));
-    }
-  }
-
-  if (ncre == 0) {
-    orbDiff = 0;
-  }
-  else if (ncre ==1 ) {
-    size_t c0=cre[0], N=bra.norbs, d0 = des[0];
-    orbDiff = c0*N+d0;
-  }
-  else if (ncre == 2) {
-    size_t c0=cre[0], c1=cre[1], d1=des[1],N=bra.norbs, d0 = des[0];
-    orbDiff = c1*N*N*N+d1*N*N+c0*N+d0;
-  }
-  else {
+  Excitation ex;
+  getExcitation(bra, ket, ex);
+  if (ex.level > 2) {
     cout << "Different greater than 2."<<endl;
     exit(0);
   }
-
+  orbDiff = ex.orbDiff;
 }
 
 //=============================================================================
@@ -601,50 +619,45 @@ CItype Hij(Determinant& bra, Determinant& ket, oneInt& I1, twoInt& I2, double& c
         size_t& orbDiff:
             Number of orbitals with differing occupations.
     */
-  int cre[200],des[200],ncre=0,ndes=0; long u,b,k,one=1;
-  cre[0]=-1; cre[1]=-1; des[0]=-1; des[1]=-1;
-
-  for (int i=0; i<Determinant::EffDetLen; i++) {
-    u = bra.repr[i] ^ ket.repr[i];
-    b = u & bra.repr[i]; //the cre bits
-    k = u & ket.repr[i]; //the des bits
-
-    while(b != 0) {
-      int pos = __builtin_ffsl(b);
-      cre[ncre] = pos-1+i*64;
-      ncre++;
-      b &= ~(one<<(pos-1));
-    }
-    while(k != 0) {
-      int pos = __builtin_ffsl(k);
-      des[ndes] = pos-1+i*64;
-      ndes++;
-      k &= ~(one<<(pos-1));
-    }
-  }
+  Excitation ex;
+  getExcitation(bra, ket, ex);
 
-  if (ncre == 0) {
+  if (ex.level == 0) {
     cout << bra<<endl;
     cout << ket<<endl;
     cout <<"Use the function for energy"<<endl;
     exit(0);
   }
-  else if (ncre ==1 ) {
-    size_t c0=cre[0], N=bra.norbs, d0 = des[0];
-    orbDiff = c0*N+d0;
-    //orbDiff = cre[0]*bra.norbs+des[0];
-    return ket.Hij_1Excite(cre[0], des[0], I1, I2);
-  }
-  else if (ncre == 2) {
-    size_t c0=cre[0], c1=cre[1], d1=des[1],N=bra.norbs, d0 = des[0];
-    orbDiff = c1*N*N*N+d1*N*N+c0*N+d0;
-    //orbDiff = cre[1]*bra.norbs*bra.norbs*bra.norbs+des[1]*bra.norbs*bra.norbs+cre[0]*bra.norbs+des[0];
-    return ket.Hij_2Excite(des[0], des[1], cre[0], cre[1], I1, I2);
-  }
-  else {
+  else if (ex.level > 2) {
     //cout << "Should not be here"<<endl;
     return 0.;
   }
+  orbDiff = ex.orbDiff;
+  return Hij(ket, ex, I1, I2);
+}
+
+//=============================================================================
+CItype Hij(Determinant& ket, Excitation& ex, oneInt& I1, twoInt& I2) {
+    /*!
+    Calculates the hamiltonian matrix element of a single or double excitation
+    of ket that was classified by getExcitation.
+
+    :Arguments:
+
+        Determinant& ket:
+            Determinant in ket.
+        Excitation& ex:
+            The excitation from ket to the bra.
+        oneInt& I1:
+           One body integrals.
+        twoInt& I2:
+           Two body integrals.
+    */
+  if (ex.level == 1)
+    return ex.sgn*ket.Hij_1ExciteNoParity(ex.cre[0], ex.des[0], I1, I2);
+
+  int I = ex.des[0], J = ex.des[1], A = ex.cre[0], B = ex.cre[1];
+  return ex.sgn*(I2(A,I,B,J) - I2(A,J,B,I));
 }
 
 
@@ -31,31 +31,36 @@ class twoInt;
 
 using namespace std;
 
-inline int BitCount (long x)
+//hash used to assign the determinants to mpi ranks (see Determinant::getHash)
+enum hashType {LEXICALHASH, MIXHASH};
+
+//Portable popcount, used when the hardware instruction is not available
+inline int BitCountSWAR (long x)
 {
   x = (x & 0x5555555555555555ULL) + ((x >> 1) & 0x5555555555555555ULL);
   x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
   x = (x & 0x0F0F0F0F0F0F0F0FULL) + ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL);
   return (x * 0x0101010101010101ULL) >> 56;
+}
 
-  //unsigned int u2=u>>32, u1=u;
-
-  //return __builtin_popcount(u2)+__builtin_popcount(u);
-  /*
-  u1 = u1
-    - ((u1 >> 1) & 033333333333)
-    - ((u1 >> 2) & 011111111111);
-
-
-  u2 = u2
-    - ((u2 >> 1) & 033333333333)
-    - ((u2 >> 2) & 011111111111);
+//Compiled with -mpopcnt (USE_POPCNT in the Makefile) this is a single
+//instruction, hasHardwareBitCount() checks at startup that the cpu has it
+inline int BitCount (long x)
+{
+#ifdef __POPCNT__
+  return __builtin_popcountl(x);
+#else
+  return BitCountSWAR(x);
+#endif
+}
 
-  return (((u1 + (u1 >> 3))
-	   & 030707070707) % 63) +
-    (((u2 + (u2 >> 3))
-      & 030707070707) % 63);
-  */
+inline bool hasHardwareBitCount()
+{
+#if defined(__POPCNT__) && (defined(__x86_64__) || defined(__i386__))
+  return __builtin_cpu_supports("popcnt");
+#else
+  return true;
+#endif
 }
 
 
@@ -65,20 +70,20 @@ class HalfDet {
   friend class boost::serialization::access;
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version) {
-    for (int i=0; i<DetLen/2; i++)
+    for (int i=0; i<HalfDetLen; i++)
       ar & repr[i];
   }
  public:
-  long repr[DetLen/2];
+  long repr[HalfDetLen];
   static int norbs;
   HalfDet() {
-    for (int i=0; i<DetLen/2; i++)
+    for (int i=0; i<HalfDetLen; i++)
       repr[i] = 0;
   }
 
   //the comparison between determinants is performed
   bool operator<(const HalfDet& d) const {
-    for (int i=DetLen/2-1; i>=0 ; i--) {
+    for (int i=HalfDetLen-1; i>=0 ; i--) {
       if (repr[i] < d.repr[i]) return true;
       else if (repr[i] > d.repr[i]) return false;
     }
@@ -86,14 +91,14 @@ class HalfDet {
   }
 
   bool operator==(const HalfDet& d) const {
-    for (int i=DetLen/2-1; i>=0 ; i--)
+    for (int i=HalfDetLen-1; i>=0 ; i--)
       if (repr[i] != d.repr[i]) return false;
     return true;
   }
 
   int ExcitationDistance(const HalfDet& d) const {
     int ndiff = 0; 
-    for (int i=0; i<DetLen/2; i++) {
+    for (int i=0; i<HalfDetLen; i++) {
       ndiff += BitCount(repr[i] ^ d.repr[i]);
     }
     return ndiff/2;
@@ -119,20 +124,36 @@ class HalfDet {
       return true;
   }
 
+  //closed orbitals in increasing order, iterates over the set bits
   int getClosed(vector<int>& closed){
     int cindex = 0;
-    for (int i=0; i<32*DetLen; i++) {
-      if (getocc(i)) {closed.at(cindex) = i; cindex++;}
+    for (int i=0; i<HalfDetLen; i++) {
+      unsigned long occ = repr[i];
+      while (occ != 0) {
+        closed.at(cindex) = i*64 + __builtin_ctzl(occ); cindex++;
+        occ &= occ-1;
+      }
     }
     return cindex;
   }
 
+  //open and closed orbitals (among the norbs/2 spatial orbitals)
   int getOpenClosed(vector<int>& open, vector<int>& closed){
     int cindex = 0;
     int oindex = 0;
-    for (int i=0; i<32*DetLen; i++) {
-      if (getocc(i)) {closed.at(cindex) = i; cindex++;}
-      else {open.at(oindex) = i; oindex++;}
+    for (int i=0; i<HalfDetLen; i++) {
+      unsigned long occ = repr[i], empty = ~occ;
+      int nbits = norbs/2 - 64*i;
+      if (nbits <= 0) empty = 0;
+      else if (nbits < 64) empty &= (1UL<<nbits)-1;
+      while (occ != 0) {
+        closed.at(cindex) = i*64 + __builtin_ctzl(occ); cindex++;
+        occ &= occ-1;
+      }
+      while (empty != 0) {
+        open.at(oindex) = i*64 + __builtin_ctzl(empty); oindex++;
+        empty &= empty-1;
+      }
     }
     return cindex;
   }
@@ -169,6 +190,7 @@ class Determinant {
   // 63rd position of the last long is the last position
   long repr[DetLen];
   static char Trev;
+  static hashType HashType;
   static int norbs;
   static int EffDetLen;
   static Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic> LexicalOrder;
@@ -219,6 +241,9 @@ class Determinant {
 
   CItype Hij_1Excite(int& i, int& a, oneInt&I1, twoInt& I2);
 
+  //Hij_1Excite without the parity of the excitation
+  CItype Hij_1ExciteNoParity(int a, int i, oneInt&I1, twoInt& I2);
+
   CItype Hij_2Excite(int& i, int& j, int& a, int& b, oneInt&I1, twoInt& I2);
 
 
@@ -239,8 +264,21 @@ class Determinant {
     return order;
   }
 
+  //multiply-xorshift mixing of the occupation words, unlike the lexical order
+  //it spreads determinants that differ in a few orbitals over all the ranks
+  size_t getMixHash() {
+    size_t h = 0x9E3779B97F4A7C15ULL;
+    for (int i=0; i<EffDetLen; i++) {
+      h ^= (size_t)repr[i];
+      h *= 0xBF58476D1CE4E5B9ULL;
+      h ^= h >> 31;
+    }
+    h *= 0x94D049BB133111EBULL;
+    return h ^ (h >> 29);
+  }
+
   size_t getHash() {
-    return getLexicalOrder();
+    return HashType == MIXHASH ? getMixHash() : getLexicalOrder();
   }
 
   bool isStandard() {
@@ -470,43 +508,151 @@ class Determinant {
   }
 
   //returns integer array containing the closed and open orbital indices
-  int getOpenClosed(unsigned short* open, unsigned short* closed) const {
+  //the set bits of each word are visited with ctz and cleared one at a time
+  template<typename T>
+  int getOpenClosedWords(T* open, T* closed) const {
     int oindex=0,cindex=0;
-    for (int i=0; i<norbs; i++) {
-      if (getocc(i)) {closed[cindex] = i; cindex++;}
-      else {open[oindex] = i; oindex++;}
+    for (int i=0; i<EffDetLen; i++) {
+      unsigned long occ = repr[i], empty = ~occ;
+      int nbits = norbs - 64*i;
+      if (nbits <= 0) empty = 0;
+      else if (nbits < 64) empty &= (1UL<<nbits)-1;
+      while (occ != 0) {
+        closed[cindex] = i*64 + __builtin_ctzl(occ); cindex++;
+        occ &= occ-1;
+      }
+      while (empty != 0) {
+        open[oindex] = i*64 + __builtin_ctzl(empty); oindex++;
+        empty &= empty-1;
+      }
     }
     return cindex;
   }
 
+  //returns integer array containing the closed and open orbital indices
+  int getOpenClosed(unsigned short* open, unsigned short* closed) const {
+    return getOpenClosedWords(open, closed);
+  }
+
   //returns integer array containing the closed and open orbital indices
   void getOpenClosed(vector<int>& open, vector<int>& closed) const {
-    int oindex=0,cindex=0;
-    for (int i=0; i<norbs; i++) {
-      if (getocc(i)) {closed.at(cindex) = i; cindex++;}
-      else {open.at(oindex) = i; oindex++;}
-    }
+    getOpenClosedWords(open.data(), closed.data());
   }
 
   //returns integer array containing the closed and open orbital indices
   int getOpenClosed(int* open, int* closed) const {
-    int oindex=0,cindex=0;
-    for (int i=0; i<norbs; i++) {
-      if (getocc(i)) {closed[cindex] = i; cindex++;}
-      else {open[oindex] = i; oindex++;}
-    }
-    return cindex;
+    return getOpenClosedWords(open, closed);
+  }
+
+};
+
+
+//Decodes a block of determinants into flat closed and open orbital lists, the
+//lists of the k-th determinant start at closed[k*nclosed] and open[k*nopen].
+//The buffers are kept between calls, so looping over a large set of
+//determinants block by block does not allocate per determinant.
+class OpenClosedBlock {
+ public:
+  int ndets, nclosed, nopen;
+  vector<int> closed, open;
+
+  OpenClosedBlock() : ndets(0), nclosed(0), nopen(0) {}
+
+  //decodes dets[0], dets[stride], ..., dets[(n-1)*stride]
+  void decode(const Determinant* dets, int n, int nelec, int stride=1) {
+    ndets = n; nclosed = nelec; nopen = Determinant::norbs-nelec;
+    if (closed.size() < (size_t)n*nclosed) closed.resize((size_t)n*nclosed);
+    if (open.size() < (size_t)n*nopen+1) open.resize((size_t)n*nopen+1);
+    for (int k=0; k<n; k++)
+      dets[(size_t)k*stride].getOpenClosedWords(&open[(size_t)k*nopen], &closed[(size_t)k*nclosed]);
+  }
+
+  //decodes dets[index[0]], ..., dets[index[n-1]]
+  void decode(const Determinant* dets, const int* index, int n, int nelec) {
+    ndets = n; nclosed = nelec; nopen = Determinant::norbs-nelec;
+    if (closed.size() < (size_t)n*nclosed) closed.resize((size_t)n*nclosed);
+    if (open.size() < (size_t)n*nopen+1) open.resize((size_t)n*nopen+1);
+    for (int k=0; k<n; k++)
+      dets[index[k]].getOpenClosedWords(&open[(size_t)k*nopen], &closed[(size_t)k*nclosed]);
   }
 
+  int* getClosed(int k) { return &closed[(size_t)k*nclosed]; }
+  int* getOpen(int k) { return &open[(size_t)k*nopen]; }
 };
 
 
-double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+double EnergyAfterExcitation(int* closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
 			     int i, int A, double Energyd) ;
-double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+double EnergyAfterExcitation(int* closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
 			     int i, int A, int j, int B, double Energyd) ;
+inline double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+			     int i, int A, double Energyd) {
+  return EnergyAfterExcitation(&closed[0], nclosed, I1, I2, coreE, i, A, Energyd);
+}
+inline double EnergyAfterExcitation(vector<int>& closed, int& nclosed, oneInt& I1, twoInt& I2, double& coreE,
+			     int i, int A, int j, int B, double Energyd) {
+  return EnergyAfterExcitation(&closed[0], nclosed, I1, I2, coreE, i, A, j, B, Energyd);
+}
+//The excitation that takes ket to bra. cre are the orbitals only occupied in
+//bra and des the ones only occupied in ket, both in increasing order.
+struct Excitation {
+  int level;       //0, 1, 2, or 3 for anything higher
+  int cre[2], des[2];
+  double sgn;      //fermionic sign of the excitation acting on ket
+  size_t orbDiff;  //packed as in getOrbDiff
+};
+
+//Classifies the excitation between bra and ket in a single pass. The bits of
+//the XOR over all DetLen words are counted first (a fixed trip count loop the
+//compiler vectorizes), the orbitals and the sign are only worked out for
+//singles and doubles.
+inline void getExcitation(Determinant& bra, Determinant& ket, Excitation& ex) {
+  long u[DetLen];
+  int ndiff = 0;
+  for (int i=0; i<DetLen; i++) {
+    u[i] = bra.repr[i] ^ ket.repr[i];
+    ndiff += BitCount(u[i]);
+  }
+  if (ndiff > 4) {
+    ex.level = 3;
+    return;
+  }
+
+  int cre[4], des[4], ncre=0, ndes=0;
+  for (int i=0; i<DetLen; i++) {
+    unsigned long b = u[i] & bra.repr[i], k = u[i] & ket.repr[i];
+    for (; b != 0; b &= b-1) cre[ncre++] = __builtin_ctzl(b) + i*64;
+    for (; k != 0; k &= k-1) des[ndes++] = __builtin_ctzl(k) + i*64;
+  }
+  if (ncre != ndes) {
+    ex.level = 3;
+    return;
+  }
+
+  size_t N = Determinant::norbs;
+  ex.level = ncre;
+  ex.sgn = 1.0;
+  if (ncre == 0)
+    ex.orbDiff = 0;
+  else if (ncre == 1) {
+    ex.cre[0] = cre[0]; ex.des[0] = des[0];
+    ex.orbDiff = cre[0]*N + des[0];
+    ket.parity(min(cre[0], des[0]), max(cre[0], des[0]), ex.sgn);
+  }
+  else {
+    ex.cre[0] = cre[0]; ex.cre[1] = cre[1]; ex.des[0] = des[0]; ex.des[1] = des[1];
+    ex.orbDiff = cre[1]*N*N*N + des[1]*N*N + cre[0]*N + des[0];
+    ket.parity(min(des[0], cre[0]), max(des[0], cre[0]), ex.sgn);
+    ket.parity(min(des[1], cre[1]), max(des[1], cre[1]), ex.sgn);
+    if (cre[0] > des[1] || cre[1] < des[0]) ex.sgn *= -1.;
+  }
+}
+
 CItype Hij(Determinant& bra, Determinant& ket, oneInt& I1, twoInt& I2, double& coreE, size_t& orbDiff);
 
+//<bra|H|ket> for a single or double excitation classified by getExcitation
+CItype Hij(Determinant& ket, Excitation& ex, oneInt& I1, twoInt& I2);
+
 CItype Hij_1Excite(int i, int a, oneInt& I1, twoInt& I2, int* closed, int& nclosed);
 
 void updateHijForTReversal(CItype& hij, Determinant& dk, Determinant& dj,
@@ -0,0 +1,81 @@
+/*
+  Developed by Sandeep Sharma with contributions from James E. T. Smith and Adam A. Holmes, 2017
+  Copyright (c) 2017, Sandeep Sharma
+
+  This file is part of DICE.
+
+  This program is free software: you can redistribute it and/or modify it under the terms
+  of the GNU General Public License as published by the Free Software Foundation,
+  either version 3 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with this program.
+  If not, see <http://www.gnu.org/licenses/>.
+*/
+//Converts an FCIDUMP file to the binary integral format, which Dice maps
+//instead of parsing when it is given as the "orbitals" file.
+//Build with "make fcidump2bin", run as "./fcidump2bin FCIDUMP FCIDUMP.bin".
+//With a third argument, "./fcidump2bin FCIDUMP FCIDUMP.bin 1e-8", the file
+//holds the Cholesky vectors of the integrals to that threshold instead.
+#include <iostream>
+#include <vector>
+#ifndef SERIAL
+#include <boost/mpi.hpp>
+#include <boost/mpi/environment.hpp>
+#endif
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include "integral.h"
+#include "SHCIshm.h"
+#include "communicate.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+#ifndef SERIAL
+  boost::mpi::environment env(argc, argv);
+#endif
+  initSHM();
+  if (argc != 3 && argc != 4) {
+    pout << "usage: fcidump2bin FCIDUMP binaryfile [choleskythreshold]"<<endl;
+    exit(0);
+  }
+
+  twoInt I2; oneInt I1;
+  int nelec, norbs; double coreE;
+  std::vector<int> irrep;
+  readIntegrals(argv[1], I2, I1, nelec, norbs, coreE, irrep);
+  if (commrank == 0) {
+    std::vector<int2Type> L;
+    if (argc == 4) {
+      if (I2.ksym || I2.nchol != 0) {
+        cout << "Cholesky vectors can only be made from real integrals without KSYM"<<endl;
+        exit(0);
+      }
+      I2.nchol = choleskyVectors(I2, atof(argv[3]), L);
+      if (I2.nchol == 0) {
+        cout << "all integrals are below the Cholesky threshold "<<argv[3]<<endl;
+        exit(0);
+      }
+      I2.store = L.data();
+      cout << "made "<<I2.nchol<<" Cholesky vectors for "<<norbs*(norbs+1)/2<<" orbital pairs"<<endl;
+    }
+    if (!writeIntegralsBinary(argv[2], I2, I1, nelec, norbs, coreE, irrep))
+      exit(0);
+    cout << "wrote "<<norbs<<" orbitals and "<<nelec<<" electrons to "<<argv[2]<<endl;
+  }
+
+  boost::interprocess::shared_memory_object::remove(shciint2.c_str());
+  boost::interprocess::shared_memory_object::remove(shciint2shm.c_str());
+  boost::interprocess::shared_memory_object::remove(shciHelper.c_str());
+  boost::interprocess::shared_memory_object::remove(shciDetsCI.c_str());
+  boost::interprocess::shared_memory_object::remove(shciSortedDets.c_str());
+  boost::interprocess::shared_memory_object::remove(shciDavidson.c_str());
+  boost::interprocess::shared_memory_object::remove(shcicMax.c_str());
+  boost::interprocess::shared_memory_object::remove(shciDiag.c_str());
+  boost::interprocess::shared_memory_object::remove(shciDetsSet.c_str());
+  return 0;
+}
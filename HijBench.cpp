@@ -0,0 +1,152 @@
+/*
+  Developed by Sandeep Sharma with contributions from James E. T. Smith and Adam A. Holmes, 2017
+  Copyright (c) 2017, Sandeep Sharma
+
+  This file is part of DICE.
+
+  This program is free software: you can redistribute it and/or modify it under the terms
+  of the GNU General Public License as published by the Free Software Foundation,
+  either version 3 of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+  See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along with this program.
+  If not, see <http://www.gnu.org/licenses/>.
+*/
+//Throughput of the Hamiltonian matrix elements on pairs of determinants that
+//look like the ones met when the Hamiltonian is built (singles, doubles and
+//unconnected pairs). "scalar" is the separate ExcitationDistance + orbital
+//extraction used before getExcitation, "fused" is getExcitation + Hij.
+//Build with "make hijbench", run as "./hijbench [norbs] [nelec]".
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "Determinants.h"
+#include "integral.h"
+
+using namespace std;
+
+int HalfDet::norbs = 1;
+int Determinant::norbs = 1;
+int Determinant::EffDetLen = 1;
+char Determinant::Trev = 0;
+hashType Determinant::HashType = LEXICALHASH;
+Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic> Determinant::LexicalOrder;
+
+//the classification done by Hij before getExcitation
+CItype HijScalar(Determinant& bra, Determinant& ket, oneInt& I1, twoInt& I2, size_t& orbDiff) {
+  int cre[200],des[200],ncre=0,ndes=0; long u,b,k,one=1;
+  for (int i=0; i<Determinant::EffDetLen; i++) {
+    u = bra.repr[i] ^ ket.repr[i];
+    b = u & bra.repr[i];
+    k = u & ket.repr[i];
+    while(b != 0) {
+      int pos = __builtin_ffsl(b);
+      cre[ncre++] = pos-1+i*64;
+      b &= ~(one<<(pos-1));
+    }
+    while(k != 0) {
+      int pos = __builtin_ffsl(k);
+      des[ndes++] = pos-1+i*64;
+      k &= ~(one<<(pos-1));
+    }
+  }
+  size_t N = bra.norbs;
+  if (ncre == 1) {
+    orbDiff = cre[0]*N+des[0];
+    return ket.Hij_1Excite(cre[0], des[0], I1, I2);
+  }
+  orbDiff = cre[1]*N*N*N+des[1]*N*N+cre[0]*N+des[0];
+  return ket.Hij_2Excite(des[0], des[1], cre[0], cre[1], I1, I2);
+}
+
+template<typename F>
+double seconds(F f) {
+  auto start = std::chrono::high_resolution_clock::now();
+  f();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(end-start).count();
+}
+
+int main(int argc, char* argv[]) {
+  int norbs = argc > 1 ? atoi(argv[1]) : 50;  //spatial orbitals
+  int nelec = argc > 2 ? atoi(argv[2]) : 20;
+  int ndets = 4096, nrep = 200;
+  Determinant::norbs = 2*norbs;
+  HalfDet::norbs = 2*norbs;
+  Determinant::EffDetLen = 2*norbs/64+1;
+  if (Determinant::EffDetLen > DetLen) {
+    cout << "norbs too large for DETLEN="<<DetLen<<endl;
+    exit(0);
+  }
+
+  //random integrals
+  srand(7);
+  oneInt I1;
+  I1.norbs = 2*norbs;
+  I1.store.resize(4*norbs*norbs);
+  for (int i=0; i<I1.store.size(); i++) I1.store[i] = 1.*rand()/RAND_MAX - 0.5;
+  size_t npair = norbs*(norbs+1)/2;
+  vector<int2Type> int2(npair*(npair+1)/2);
+  for (size_t i=0; i<int2.size(); i++) int2[i] = 1.*rand()/RAND_MAX - 0.5;
+  twoInt I2;
+  I2.store = &int2[0];
+  I2.norbs = norbs;
+  I2.ksym = false;
+  I2.initPairIndex();
+
+  //each determinant is paired with a single, a double and a random determinant
+  vector<Determinant> bra, ket;
+  for (int d=0; d<ndets; d++) {
+    Determinant det;
+    for (int n=0; n<nelec; ) {
+      int orb = rand()%(2*norbs);
+      if (!det.getocc(orb)) {det.setocc(orb, true); n++;}
+    }
+    for (int nex=1; nex<=3; nex++) {
+      Determinant other = det;
+      for (int e=0; e<(nex == 3 ? nelec : nex); e++) {
+        int i, a;
+        do i = rand()%(2*norbs); while (!other.getocc(i));
+        do a = rand()%(2*norbs); while (other.getocc(a));
+        other.setocc(i, false); other.setocc(a, true);
+      }
+      if (other == det) continue;
+      bra.push_back(other); ket.push_back(det);
+    }
+  }
+  size_t npairs = bra.size(), ncalls = npairs*nrep;
+
+  cout << "norbs "<<norbs<<"  nelec "<<nelec<<"  DETLEN "<<DetLen<<"  pairs "<<npairs<<endl;
+  CItype sumScalar = 0., sumFused = 0.;
+  size_t diffScalar = 0, diffFused = 0;
+  double t = seconds([&]() {
+      for (int r=0; r<nrep; r++)
+        for (size_t p=0; p<npairs; p++)
+          if (bra[p].ExcitationDistance(ket[p]) <= 2) {
+            size_t orbDiff;
+            sumScalar += HijScalar(bra[p], ket[p], I1, I2, orbDiff);
+            diffScalar += orbDiff;
+          }
+    });
+  cout << "scalar  "<<ncalls/t<<" pairs/s"<<endl;
+  t = seconds([&]() {
+      for (int r=0; r<nrep; r++)
+        for (size_t p=0; p<npairs; p++) {
+          Excitation ex;
+          getExcitation(bra[p], ket[p], ex);
+          if (ex.level <= 2) {
+            sumFused += Hij(ket[p], ex, I1, I2);
+            diffFused += ex.orbDiff;
+          }
+        }
+    });
+  cout << "fused   "<<ncalls/t<<" pairs/s"<<endl;
+
+  cout << "checksum "<<sumScalar<<" "<<sumFused<<" "<<diffScalar<<" "<<diffFused<<endl;
+  return 0;
+}
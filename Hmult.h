@@ -169,6 +169,7 @@ struct HmultDirect {
   twoInt& I2;
   double& coreE;
   MatrixXx& diag;
+  double* DiagSHM; //cached <D_k|H|D_k>, recomputed when NULL
 
   HmultDirect(
           SHCImakeHamiltonian::HamHelpers2& helpers2,
@@ -179,7 +180,8 @@ struct HmultDirect {
           oneInt& pI1,
           twoInt& pI2,
           double& pcoreE,
-          MatrixXx& pDiag) :
+          MatrixXx& pDiag,
+          double* pDiagSHM=NULL) :
     AlphaMajorToBetaLen(helpers2.AlphaMajorToBetaLen),
     AlphaMajorToBeta   (helpers2.AlphaMajorToBetaSM ),
     AlphaMajorToDet    (helpers2.AlphaMajorToDetSM  ),
@@ -197,7 +199,8 @@ struct HmultDirect {
     I1                 (pI1                         ),
     I2                 (pI2                         ),
     coreE              (pcoreE                      ),
-    diag               (pDiag                       ) {};
+    diag               (pDiag                       ),
+    DiagSHM            (pDiagSHM                    ) {};
 
 
   HmultDirect(
@@ -218,7 +221,8 @@ struct HmultDirect {
           oneInt& pI1,
           twoInt& pI2,
           double& pcoreE,
-          MatrixXx& pDiag) :
+          MatrixXx& pDiag,
+          double* pDiagSHM=NULL) :
     AlphaMajorToBetaLen(pAlphaMajorToBetaLen),
     AlphaMajorToBeta   (pAlphaMajorToBeta   ),
     AlphaMajorToDet    (pAlphaMajorToDet    ),
@@ -236,7 +240,8 @@ struct HmultDirect {
     I1                 (pI1                 ),
     I2                 (pI2                 ),
     coreE              (pcoreE              ),
-    diag               (pDiag               ) {};
+    diag               (pDiag               ),
+    DiagSHM            (pDiagSHM            ) {};
 
   void operator()(CItype *x, CItype *y) {
     if (StartIndex >= DetsSize) return;
@@ -250,7 +255,7 @@ struct HmultDirect {
     //diagonal element
     for (size_t k=StartIndex; k<DetsSize; k++) {
       if (k%(nprocs) != proc) continue;
-      CItype hij = Dets[k].Energy(I1, I2, coreE);
+      CItype hij = DiagSHM != NULL ? DiagSHM[k] : Dets[k].Energy(I1, I2, coreE);
       size_t orbDiff;
       if (Determinant::Trev != 0)
         updateHijForTReversal(hij, Dets[k], Dets[k], I1, I2, coreE, orbDiff);
@@ -354,9 +359,12 @@ struct HmultDirect {
           if (abs(DetJ) == abs(DetI) ) continue;
           Determinant dj = Dets[abs(DetJ)-1];
           if (DetJ <0) dj.flipAlphaBeta();
-          if (dj.ExcitationDistance(Dets[DetI-1]) == 2) {
-            size_t orbDiff;
-            CItype hij = Hij(Dets[abs(DetI)-1], Dets[abs(DetJ)-1], I1, I2, coreE, orbDiff);
+          Excitation ex;
+          getExcitation(Dets[DetI-1], dj, ex);
+          if (ex.level == 2) {
+            size_t orbDiff = ex.orbDiff;
+            CItype hij = DetJ > 0 ? Hij(dj, ex, I1, I2) :
+                Hij(Dets[abs(DetI)-1], Dets[abs(DetJ)-1], I1, I2, coreE, orbDiff);
             fixForTreversal(Dets, DetI, DetJ, I1, I2, coreE, orbDiff, hij);
             y[abs(DetI)-1] += hij*x[abs(DetJ)-1];
           }
@@ -368,9 +376,12 @@ struct HmultDirect {
           if (abs(DetJ) == abs(DetI) ) continue;
           Determinant dj = Dets[std::abs(DetJ)-1];
           if (DetJ <0) dj.flipAlphaBeta();
-          if (Dets[DetI-1].ExcitationDistance(dj) == 2 ) {
-            size_t orbDiff;
-            CItype hij = Hij(Dets[abs(DetI)-1], Dets[abs(DetJ)-1], I1, I2, coreE, orbDiff);
+          Excitation ex;
+          getExcitation(Dets[DetI-1], dj, ex);
+          if (ex.level == 2) {
+            size_t orbDiff = ex.orbDiff;
+            CItype hij = DetJ > 0 ? Hij(dj, ex, I1, I2) :
+                Hij(Dets[abs(DetI)-1], Dets[abs(DetJ)-1], I1, I2, coreE, orbDiff);
             fixForTreversal(Dets, DetI, DetJ, I1, I2, coreE, orbDiff, hij);
             y[abs(DetI)-1] += hij*x[abs(DetJ)-1];
           }
@@ -108,6 +108,8 @@ void LCC::doLCC(
 #endif
   SHMVecFromVecs(SortedDetsvec, SortedDets, shciSortedDets, SortedDetsSegment, regionSortedDets);
   SortedDetsvec.clear();
+  DeterminantSet space;
+  space.make(SortedDets, DetsSize);
 
   // PT2  ================================================================
 
@@ -120,14 +122,21 @@ void LCC::doLCC(
   int class_act[8] = { 0,  1, -1,  2, -2,  0, -1,  1};
   int class_vir[8] = { 2,  1,  2,  0,  2,  1,  1,  0};
 
+  // the references of this rank, the same for all the classes
+  vector<double> cutoff(DetsSize);
+  for (int i=0; i<DetsSize; i++) cutoff[i] = abs(schd.epsilon2/ci[i]);
+  WorkDistribution work;
+  work.distribute(cutoff, I2HB, nelec);
+  double busy = 0.;
+
   // Loop for classes
   for (int iclass=0; iclass<8; iclass++){
     double tA=getTime();
 
     // Accumulate the LCC determinants
     StitchDEH uniqueDEH; uniqueDEH.clear();
-    for (int i=0; i<DetsSize; i++) {
-      if ((i%size != rank)) continue;
+    for (int k=0; k<work.mine.size(); k++) {
+      int i = work.mine[k];
       LCC::getDeterminantsLCC(
               Dets[i], abs(schd.epsilon2/ci[i]), ci[i], 0.0,
               I1, I2, I2HB, irrep, coreE, E0,
@@ -137,10 +146,11 @@ void LCC::doLCC(
               schd,0, nelec,
               class_cor[iclass],class_act[iclass],class_vir[iclass]);
     }
+    busy += getTime()-tA;
 
     // Unique ones (via merge, etc...)
     uniqueDEH.MergeSortAndRemoveDuplicates();
-    uniqueDEH.RemoveDetsPresentIn(SortedDets, DetsSize);
+    uniqueDEH.RemoveDetsPresentIn(space);
 
     // (communications) -------------------------------------------------------
     for (int level = 0; level <ceil(log2(size)); level++) {
@@ -263,6 +273,8 @@ void LCC::doLCC(
           <<endl;
 
   } // iclass
+  work.busy = busy;
+  work.printBusyTime("LCC");
   cout<<"Total PT              "<<format("%20.9e") %(totalpt)<<endl;
 
   // PT3  ================================================================
@@ -472,6 +484,7 @@ void LCC::getDeterminantsLCC(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) <epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -484,14 +497,15 @@ void LCC::getDeterminantsLCC(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) <epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2*orbIndices[2*index] + closed[i]%2, b = 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       LCC::get_landscape(closed[i],closed[j],a,b,&d_cor,&d_act,&d_vir, schd);
       if (d_cor!=class_cor || d_act!=class_act || d_vir!=class_vir) {
         //cout<<format("BM i: %3i %3i j: %3i %3i a: %3i b: %3i") %(i) %(closed[i]) %(j) %(closed[j]) %(a) %(b);
@@ -49,6 +49,7 @@ int HalfDet::norbs = 1; //spin orbitals
 int Determinant::norbs = 1; //spin orbitals
 int Determinant::EffDetLen = 1;
 char Determinant::Trev = 0; //Time reversal
+hashType Determinant::HashType = LEXICALHASH;
 Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic> Determinant::LexicalOrder ;
 //get the current time
 double getTime() {
@@ -90,6 +91,7 @@ int main(int argc, char* argv[]) {
     schd.Trev = 0;
   }
   Determinant::Trev = schd.Trev;
+  Determinant::HashType = schd.DetHash;
   omp_set_num_threads(schd.num_thrds);
 
   int nelec = HFoccupied[0].size();
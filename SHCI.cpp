@@ -66,6 +66,7 @@ int HalfDet::norbs = 1;      // spin orbitals
 int Determinant::norbs = 1;  // spin orbitals
 int Determinant::EffDetLen = 1;
 char Determinant::Trev = 0;  // Time reversal
+hashType Determinant::HashType = LEXICALHASH;
 Eigen::Matrix<size_t, Eigen::Dynamic, Eigen::Dynamic> Determinant::LexicalOrder;
 
 // Get the current time
@@ -164,6 +165,12 @@ int main(int argc, char* argv[]) {
   // Initialize
   initSHM();
   if (commrank == 0) license(argv);
+  if (!hasHardwareBitCount()) {
+    pout << "This cpu does not support popcnt, set USE_POPCNT = no in the "
+            "Makefile and recompile."
+         << endl;
+    exit(0);
+  }
 
   // Read the input file
   string inputFile = "input.dat";
@@ -172,10 +179,6 @@ int main(int argc, char* argv[]) {
   schedule schd;
   if (commrank == 0) readInput(inputFile, HFoccupied, schd);
   if (schd.outputlevel > 0 && commrank == 0) Time::print_time("begin");
-  if (DetLen % 2 == 1) {
-    pout << "Change DetLen in global to an even number and recompile." << endl;
-    exit(0);
-  }
 
 #ifndef SERIAL
   mpi::broadcast(world, HFoccupied, 0);
@@ -190,6 +193,7 @@ int main(int argc, char* argv[]) {
     schd.Trev = 0;
   }
   Determinant::Trev = schd.Trev;
+  Determinant::HashType = schd.DetHash;
 
   // Set the random seed
   startofCalc = getTime();
@@ -205,7 +209,27 @@ int main(int argc, char* argv[]) {
   int norbs;
   double coreE = 0.0, eps;
   std::vector<int> irrep;
-  readIntegrals(schd.integralFile, I2, I1, nelec, norbs, coreE, irrep);
+  // with an integral cache, the integrals are read from its binary copy of
+  // the integral file if it is there, and the copy is written otherwise
+  string integralCache = "";
+  if (schd.integralCache != "")
+    integralCache =
+        integralCacheName(schd.integralFile, schd.integralCache, 1.e-10);
+  int cachedIntegrals = 0;
+  if (integralCache != "" && commrank == 0)
+    cachedIntegrals = isBinaryIntegralFile(integralCache + ".int");
+#ifndef SERIAL
+  mpi::broadcast(world, cachedIntegrals, 0);
+#endif
+  if (cachedIntegrals) {
+    pout << "Reading the integrals from the cache " << integralCache << endl;
+    readIntegrals(integralCache + ".int", I2, I1, nelec, norbs, coreE, irrep);
+  } else {
+    readIntegrals(schd.integralFile, I2, I1, nelec, norbs, coreE, irrep);
+    if (integralCache != "" && commrank == 0)
+      writeIntegralsBinary(integralCache + ".int", I2, I1, nelec, norbs, coreE,
+                           irrep);
+  }
 
   // Check
   if (HFoccupied[0].size() != nelec) {
@@ -233,18 +257,25 @@ int main(int argc, char* argv[]) {
   Determinant::EffDetLen = norbs / 64 + 1;
   Determinant::initLexicalOrder(nelec);
   if (Determinant::EffDetLen > DetLen) {
-    pout << "change DetLen in global.h to " << Determinant::EffDetLen
+    pout << "change DETLEN in the Makefile to " << Determinant::EffDetLen
          << " and recompile " << endl;
     exit(0);
   }
+  if (Determinant::EffDetLen < DetLen && schd.outputlevel > 0)
+    pout << "#compiled with DETLEN=" << DetLen << ", recompiling with DETLEN="
+         << Determinant::EffDetLen << " will reduce memory" << endl;
 
   // Initialize the Heat-Bath integrals
-  std::vector<int> allorbs;
-  for (int i = 0; i < norbs / 2; i++) allorbs.push_back(i);
-  twoIntHeatBath I2HB(1.e-10);
   twoIntHeatBathSHM I2HBSHM(1.e-10);
-  if (commrank == 0) I2HB.constructClass(allorbs, I2, I1, norbs / 2);
-  I2HBSHM.constructClass(norbs / 2, I2HB);
+  if (integralCache != "" &&
+      I2HBSHM.readCache(integralCache + ".hb", norbs / 2)) {
+    pout << "Reading the heat bath integrals from the cache " << integralCache
+         << endl;
+  } else {
+    I2HBSHM.constructClass(norbs / 2, I2, I1);
+    if (integralCache != "" && commrank == 0)
+      I2HBSHM.writeCache(integralCache + ".hb", norbs / 2);
+  }
 
   int num_thrds;
 
@@ -28,6 +28,7 @@
 #include "Hmult.h"
 #include <tuple>
 #include <map>
+#include <queue>
 #include "Davidson.h"
 #include "boost/format.hpp"
 #include <fstream>
@@ -1046,6 +1047,249 @@ namespace SHCISortMpiUtils {
   } // merge
 
 
+//=============================================================================
+  void DeterminantSet::make(Determinant* dets_, int ndets) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Makes the set of the node-shared determinants dets_, which must stay
+  in place while the set is used. The slots are at most half full, they are
+  filled by the threads of the first rank on every node. Called by all ranks.
+
+  :Inputs:
+
+      Determinant* dets_:
+          The node-shared determinants
+      int ndets:
+          Number of determinants
+  */
+  //-----------------------------------------------------------------------------
+    dets = dets_;
+    size_t nslots = 2;
+    while (nslots < 2*(size_t)ndets) nslots *= 2;
+    mask = nslots-1;
+
+    regionDetsSet = boost::interprocess::mapped_region();
+#ifndef SERIAL
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+    if (localrank == 0) DetsSetSegment.truncate(nslots*sizeof(size_t));
+#ifndef SERIAL
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+    regionDetsSet = boost::interprocess::mapped_region{DetsSetSegment,
+                                                       boost::interprocess::read_write};
+    slots = static_cast<size_t*>(regionDetsSet.get_address());
+    if (localrank == 0) {
+      memset(slots, 0, nslots*sizeof(size_t));
+#pragma omp parallel for
+      for (int i=0; i<ndets; i++) {
+        size_t hash = dets[i].getMixHash();
+        size_t value = (hash >> 32 << 32) | (size_t)(i+1);
+        for (size_t p = hash & mask; ; p = (p+1) & mask)
+          if (__sync_bool_compare_and_swap(&slots[p], (size_t)0, value)) break;
+      }
+    }
+#ifndef SERIAL
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  }
+
+  bool DeterminantSet::contains(Determinant& d) const {
+    size_t hash = d.getMixHash();
+    for (size_t p = hash & mask; ; p = (p+1) & mask) {
+      size_t value = slots[p];
+      if (value == 0) return false;
+      if ((value >> 32) == (hash >> 32) && dets[(value & 0xFFFFFFFF) - 1] == d)
+        return true;
+    }
+  }
+
+  void StitchDEH::RemoveDetsPresentIn(const DeterminantSet& space) {
+    size_t uniqueSize = 0;
+    for (size_t i=0; i<Det->size(); i++) {
+      if (space.contains(Det->operator[](i))) continue;
+      Det->operator[](uniqueSize) = Det->operator[](i);
+      Num->operator[](uniqueSize) = Num->operator[](i);
+      if (Num2->size() != 0)
+        Num2->operator[](uniqueSize) = Num2->operator[](i);
+      if (present->size() != 0)
+        present->operator[](uniqueSize) = present->operator[](i);
+      Energy->operator[](uniqueSize) = Energy->operator[](i);
+      if (extra_info) {
+        var_indices->operator[](uniqueSize) = var_indices->operator[](i);
+        orbDifference->operator[](uniqueSize) = orbDifference->operator[](i);
+      }
+      uniqueSize++;
+    }
+    Det->resize(uniqueSize); Num->resize(uniqueSize);
+    if (Num2->size() != 0) Num2->resize(uniqueSize);
+    if (present->size() != 0) present->resize(uniqueSize);
+    Energy->resize(uniqueSize);
+    if (extra_info) {
+      var_indices->resize(uniqueSize); orbDifference->resize(uniqueSize);
+    }
+  }
+
+  void StitchDEH::RemoveOnlyDetsPresentIn(const DeterminantSet& space) {
+    size_t uniqueSize = 0;
+    for (size_t i=0; i<Det->size(); i++)
+      if (!space.contains(Det->operator[](i)))
+        Det->operator[](uniqueSize++) = Det->operator[](i);
+    Det->resize(uniqueSize);
+  }
+
+
+//=============================================================================
+  static void heatBathHistogram(twoIntHeatBathSHM& I2hb, vector<double>& above) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Counts the heat bath entries of all orbital pairs in buckets of the binary
+  exponent of their magnitude, bucket b holds [2^-(b+1), 2^-b).
+
+  :Inputs:
+
+      twoIntHeatBathSHM& I2hb:
+          The heat bath integrals
+      vector<double>& above:
+          above[b] is the number of entries of at least 2^-b (output)
+  */
+  //-----------------------------------------------------------------------------
+    const int nbuckets = 64;
+    int norbs = Determinant::norbs/2;
+    size_t npair = norbs*(norbs+1)/2;
+    size_t nentries[2] = {I2hb.startingIndicesSameSpin[npair],
+                          I2hb.startingIndicesOppositeSpin[npair]};
+    float* integrals[2] = {I2hb.sameSpinIntegrals, I2hb.oppositeSpinIntegrals};
+
+    vector<double> count(nbuckets, 0.);
+    for (int spin=0; spin<2; spin++) {
+#pragma omp parallel
+      {
+        vector<double> local(nbuckets, 0.);
+#pragma omp for
+        for (size_t index=0; index<nentries[spin]; index++) {
+          int exponent;
+          frexp(fabs(integrals[spin][index]), &exponent);
+          local[min(nbuckets-1, max(0, -exponent))] += 1.;
+        }
+#pragma omp critical
+        for (int b=0; b<nbuckets; b++) count[b] += local[b];
+      }
+    }
+
+    above.assign(nbuckets+1, 0.);
+    for (int b=0; b<nbuckets; b++) above[b+1] = above[b] + count[b];
+  }
+
+//=============================================================================
+  void WorkDistribution::distribute(const vector<double>& cutoff,
+                                    twoIntHeatBathSHM& I2hb, int nelec,
+                                    const vector<double>* screened) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Assigns the reference determinants to the ranks. The cost of a reference
+  is the number of its occupied pairs times one plus the average number of
+  heat bath entries above its cutoff, the references are sorted by it and
+  every one goes to the rank with the least estimated work (greedy longest
+  first). Every rank makes the same assignment and keeps its own part.
+
+  :Inputs:
+
+      const vector<double>& cutoff:
+          The screening cutoff epsilon/|c_i| of every reference
+      twoIntHeatBathSHM& I2hb:
+          The heat bath integrals
+      int nelec:
+          Number of electrons
+      const vector<double>* screened:
+          If not NULL, the cutoff every reference was screened with before,
+          only the entries between the two cutoffs are counted and a
+          reference with a larger cutoff now costs nothing
+  */
+  //-----------------------------------------------------------------------------
+    // the histogram only depends on the integrals, it is made once
+    static vector<double> above;
+    static twoIntHeatBathSHM* histogramOf = NULL;
+    if (histogramOf != &I2hb) {
+      heatBathHistogram(I2hb, above);
+      histogramOf = &I2hb;
+    }
+    int norbs = Determinant::norbs/2;
+    double npair = 2.*norbs*(norbs+1)/2;
+    double nocc = 0.5*nelec*(nelec-1);
+
+    // the entries in the bucket of the cutoff count half
+    int nbuckets = above.size()-1;
+    auto entriesAbove = [&](double eps) {
+      int exponent = -nbuckets;
+      if (eps != 0.) frexp(min(eps, 1.), &exponent);
+      int b = min(nbuckets-1, max(0, -exponent));
+      return 0.5*(above[b] + above[b+1]);
+    };
+    vector<pair<double, int> > cost(cutoff.size());
+    for (int i=0; i<cutoff.size(); i++) {
+      double entries = entriesAbove(cutoff[i]);
+      if (screened != NULL && screened->at(i) <= cutoff[i])
+        cost[i] = make_pair(0., i);
+      else {
+        if (screened != NULL) entries -= entriesAbove(screened->at(i));
+        cost[i] = make_pair(-nocc*(1. + entries/npair), i);
+      }
+    }
+    std::sort(cost.begin(), cost.end());
+
+    // the least loaded rank on top, the lower rank wins a tie
+    typedef pair<double, int> load;
+    priority_queue<load, vector<load>, greater<load> > ranks;
+    for (int r=0; r<commsize; r++) ranks.push(load(0., r));
+
+    mine.clear(); estimate = 0.; busy = 0.;
+    for (int k=0; k<cost.size(); k++) {
+      load least = ranks.top(); ranks.pop();
+      if (least.second == commrank) {
+        mine.push_back(cost[k].second);
+        estimate -= cost[k].first;
+      }
+      least.first -= cost[k].first;
+      ranks.push(least);
+    }
+  }
+
+//=============================================================================
+  void WorkDistribution::printBusyTime(const char* label) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Prints the time every rank spent on its references and the imbalance
+  max/average of the time and of the estimated cost.
+
+  :Inputs:
+
+      const char* label:
+          Name of the work
+  */
+  //-----------------------------------------------------------------------------
+    vector<double> times(commsize, busy), estimates(commsize, estimate);
+#ifndef SERIAL
+    MPI_Gather(&busy, 1, MPI_DOUBLE, &times[0], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gather(&estimate, 1, MPI_DOUBLE, &estimates[0], 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+    double totalTime = 0., largestTime = 0., totalEstimate = 0., largestEstimate = 0.;
+    for (int r=0; r<commsize; r++) {
+      totalTime += times[r]; largestTime = max(largestTime, times[r]);
+      totalEstimate += estimates[r]; largestEstimate = max(largestEstimate, estimates[r]);
+    }
+    pout << "#" << label << " busy seconds per rank:";
+    for (int r=0; r<commsize; r++) {
+      if (r % 8 == 0 && r != 0) pout << endl << "#";
+      pout << format(" %.2f") % times[r];
+    }
+    pout << endl;
+    pout << format("#%s busy imbalance (max/avg): %.3f, estimated %.3f") % label
+      % (totalTime == 0. ? 1.0 : largestTime*commsize/totalTime)
+      % (totalEstimate == 0. ? 1.0 : largestEstimate*commsize/totalEstimate) << endl;
+  }
+
+
 
 
 };
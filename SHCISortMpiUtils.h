@@ -80,6 +80,36 @@ namespace SHCISortMpiUtils {
 
  int ipow(int base, int exp);
 
+ //Open addressing set of the determinants of the variational space, in the
+ //node-shared DetsSetSegment. A slot holds 32 bits of getMixHash and the
+ //index of the determinant plus one (0 is empty), so a determinant that is
+ //not in the set is rejected after about one cache miss.
+ class DeterminantSet {
+ public:
+   Determinant* dets;   //the determinants the indices point to
+   size_t* slots;
+   size_t mask;         //number of slots minus one
+
+   DeterminantSet() : dets(NULL), slots(NULL), mask(0) {}
+   void make(Determinant* dets, int ndets);
+   bool contains(Determinant& d) const;
+ };
+
+ //The reference determinants of this rank. Their cost is estimated from the
+ //number of heat bath entries above their cutoff epsilon/|c_i|, and they are
+ //handed out most expensive first to the rank with the least work so far.
+ class WorkDistribution {
+ public:
+   vector<int> mine;    //references of this rank, most expensive first
+   double estimate;     //estimated cost of mine
+   double busy;         //seconds this rank spent on mine
+
+   WorkDistribution() : estimate(0.), busy(0.) {}
+   void distribute(const vector<double>& cutoff, twoIntHeatBathSHM& I2hb, int nelec,
+                   const vector<double>* screened=NULL);
+   void printBusyTime(const char* label);
+ };
+
 
  class StitchDEH {
  private:
@@ -133,6 +163,8 @@ namespace SHCISortMpiUtils {
    void RemoveDetsPresentIn(Determinant* SortedDets, int DetsSize);
    void RemoveOnlyDetsPresentIn(Determinant* SortedDets, int DetsSize);
    void RemoveOnlyDetsPresentIn(std::vector<Determinant>& SortedDets) ;
+   void RemoveDetsPresentIn(const DeterminantSet& space);
+   void RemoveOnlyDetsPresentIn(const DeterminantSet& space);
    void RemoveDuplicates();
    void deepCopy(const StitchDEH& s);
    void operator=(const StitchDEH& s);
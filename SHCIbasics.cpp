@@ -27,7 +27,9 @@
 #include <boost/serialization/shared_ptr.hpp>
 #include <boost/serialization/vector.hpp>
 #include <fstream>
+#include <limits>
 #include <map>
+#include <omp.h>
 #include <tuple>
 #include <vector>
 #include "Davidson.h"
@@ -52,6 +54,242 @@ using namespace Eigen;
 using namespace boost;
 using namespace SHCISortMpiUtils;
 
+//=============================================================================
+static void printOwnershipHistogram(vector<size_t>& all_to_all, int size,
+                                    const char* label) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Prints the number of determinants every rank received in an all-to-all
+  exchange and the imbalance max/average, to check the owner hash (dethash).
+
+  :Inputs:
+
+      vector<size_t>& all_to_all:
+          The reduced send counts, all_to_all[i*size+j] is sent from i to j
+      int size:
+          Number of ranks
+      const char* label:
+          Name of the exchange
+  */
+  //-----------------------------------------------------------------------------
+  vector<size_t> received(size, 0);
+  size_t total = 0, largest = 0;
+  for (int i = 0; i < size; i++)
+    for (int j = 0; j < size; j++) received[j] += all_to_all[i * size + j];
+  for (int j = 0; j < size; j++) {
+    total += received[j];
+    largest = max(largest, received[j]);
+  }
+  pout << "#" << label << " determinants per rank:";
+  for (int j = 0; j < size; j++) {
+    if (j % 8 == 0 && j != 0) pout << endl << "#";
+    pout << " " << received[j];
+  }
+  pout << endl;
+  pout << format("#%s imbalance (max/avg): %.3f") % label %
+              (total == 0 ? 1.0 : 1.0 * largest * size / total)
+       << endl;
+}
+
+//=============================================================================
+static void mergeSortedDets(vector<vector<Determinant> >& threadDets,
+                            vector<Determinant>& dets) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Merges sorted vectors of determinants without duplicates, made by the
+  OpenMP threads or received from the ranks, into one sorted vector without
+  duplicates. The range of determinants is cut at splitters sampled from all
+  the vectors, and every thread does a k-way merge of its part of all the
+  vectors.
+
+  :Inputs:
+
+      vector<vector<Determinant> >& threadDets:
+          The sorted vectors, emptied
+      vector<Determinant>& dets:
+          The merged determinants (output)
+  */
+  //-----------------------------------------------------------------------------
+  int nvec = threadDets.size();
+  if (nvec == 1) {
+    dets.swap(threadDets[0]);
+    return;
+  }
+
+  // nvec-1 splitters, the part s is [splitters[s-1], splitters[s])
+  vector<Determinant> samples;
+  for (int v = 0; v < nvec; v++)
+    for (int k = 1; k <= nvec; k++)
+      if (threadDets[v].size() != 0)
+        samples.push_back(threadDets[v][(threadDets[v].size() - 1) * k / nvec]);
+  std::sort(samples.begin(), samples.end());
+  vector<Determinant> splitters;
+  for (int s = 1; s < nvec && samples.size() != 0; s++)
+    splitters.push_back(samples[samples.size() * s / nvec]);
+  int nparts = splitters.size() + 1;
+
+  typedef std::pair<Determinant*, Determinant*> range;
+  vector<vector<Determinant> > parts(nparts);
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < nparts; s++) {
+    // the ranges of the vectors in this part, as a heap on their first element
+    vector<range> heap;
+    for (int v = 0; v < nvec; v++) {
+      Determinant* begin = threadDets[v].data();
+      Determinant* end = begin + threadDets[v].size();
+      Determinant* first =
+          s == 0 ? begin : std::lower_bound(begin, end, splitters[s - 1]);
+      Determinant* last =
+          s == nparts - 1 ? end : std::lower_bound(begin, end, splitters[s]);
+      if (first != last) heap.push_back(range(first, last));
+    }
+    auto later = [](const range& x, const range& y) {
+      return *y.first < *x.first;
+    };
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (heap.size() != 0) {
+      std::pop_heap(heap.begin(), heap.end(), later);
+      range& r = heap.back();
+      if (parts[s].size() == 0 || !(parts[s].back() == *r.first))
+        parts[s].push_back(*r.first);
+      if (++r.first == r.second)
+        heap.pop_back();
+      else
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+  }
+  for (int v = 0; v < nvec; v++) vector<Determinant>().swap(threadDets[v]);
+
+  vector<size_t> offset(nparts + 1, 0);
+  for (int s = 0; s < nparts; s++) offset[s + 1] = offset[s] + parts[s].size();
+  dets.resize(offset[nparts]);
+#pragma omp parallel for schedule(dynamic)
+  for (int s = 0; s < nparts; s++) {
+    std::copy(parts[s].begin(), parts[s].end(), dets.begin() + offset[s]);
+    vector<Determinant>().swap(parts[s]);
+  }
+}
+
+#ifndef SERIAL
+// the vectors of the runs of dets given by their sizes
+static void splitRuns(vector<Determinant>& dets, vector<int>& sizes,
+                      vector<vector<Determinant> >& runs) {
+  runs.resize(sizes.size());
+  size_t start = 0;
+  for (int r = 0; r < sizes.size(); r++) {
+    runs[r].assign(dets.begin() + start, dets.begin() + start + sizes[r]);
+    start += sizes[r];
+  }
+  vector<Determinant>().swap(dets);
+}
+
+//=============================================================================
+static void sendDetsToOwners(vector<Determinant>& dets, bool printHistogram) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Sends the determinants to the ranks that own them (getHash()%commsize)
+  with one all-to-all, like the PT does. The runs received from the ranks
+  are sorted, so the duplicates between ranks are removed by merging them.
+
+  :Inputs:
+
+      vector<Determinant>& dets:
+          Sorted determinants without duplicates, replaced by the sorted
+          determinants without duplicates owned by this rank
+      bool printHistogram:
+          Print the number of determinants every rank receives
+  */
+  //-----------------------------------------------------------------------------
+  int size = commsize, rank = commrank;
+  MPI_Datatype detType;
+  MPI_Type_contiguous(sizeof(Determinant) / sizeof(double), MPI_DOUBLE,
+                      &detType);
+  MPI_Type_commit(&detType);
+
+  // a stable partition by owner keeps every run sorted
+  vector<int> owner(dets.size());
+  vector<size_t> all_to_all(size * size, 0);
+  for (size_t i = 0; i < dets.size(); i++) {
+    owner[i] = dets[i].getHash() % size;
+    all_to_all[rank * size + owner[i]]++;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &all_to_all[0], size * size, MPI_UNSIGNED_LONG,
+                MPI_SUM, MPI_COMM_WORLD);
+  if (printHistogram) printOwnershipHistogram(all_to_all, size, "selection");
+
+  vector<int> sendcts(size), senddisp(size, 0), recvcts(size),
+      recvdisp(size, 0);
+  for (int i = 0; i < size; i++) {
+    sendcts[i] = all_to_all[rank * size + i];
+    recvcts[i] = all_to_all[i * size + rank];
+    if (i != 0) {
+      senddisp[i] = senddisp[i - 1] + sendcts[i - 1];
+      recvdisp[i] = recvdisp[i - 1] + recvcts[i - 1];
+    }
+  }
+  vector<Determinant> sendDets(dets.size() + 1);
+  vector<int> counter(senddisp);
+  for (size_t i = 0; i < dets.size(); i++)
+    sendDets[counter[owner[i]]++] = dets[i];
+  vector<Determinant>().swap(dets);
+
+  vector<Determinant> recvDets(recvdisp[size - 1] + recvcts[size - 1] + 1);
+  MPI_Alltoallv(&sendDets[0].repr[0], &sendcts[0], &senddisp[0], detType,
+                &recvDets[0].repr[0], &recvcts[0], &recvdisp[0], detType,
+                MPI_COMM_WORLD);
+  MPI_Type_free(&detType);
+  vector<Determinant>().swap(sendDets);
+
+  recvDets.pop_back();
+  vector<vector<Determinant> > runs;
+  splitRuns(recvDets, recvcts, runs);
+  mergeSortedDets(runs, dets);
+}
+
+//=============================================================================
+static void gatherDetsOnRoot(vector<Determinant>& dets) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Gathers the sorted determinants of all ranks on rank 0, where they are
+  merged into one sorted vector. The ranks own disjoint sets, so this only
+  restores the order.
+
+  :Inputs:
+
+      vector<Determinant>& dets:
+          Sorted determinants of this rank, replaced by all of them on rank 0
+          and emptied on the other ranks
+  */
+  //-----------------------------------------------------------------------------
+  int size = commsize;
+  MPI_Datatype detType;
+  MPI_Type_contiguous(sizeof(Determinant) / sizeof(double), MPI_DOUBLE,
+                      &detType);
+  MPI_Type_commit(&detType);
+
+  int ndets = dets.size();
+  vector<int> recvcts(size, 0), recvdisp(size, 0);
+  MPI_Gather(&ndets, 1, MPI_INT, &recvcts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+  for (int i = 1; i < size; i++) recvdisp[i] = recvdisp[i - 1] + recvcts[i - 1];
+
+  vector<Determinant> recvDets;
+  if (commrank == 0) recvDets.resize(recvdisp[size - 1] + recvcts[size - 1] + 1);
+  dets.push_back(Determinant());
+  MPI_Gatherv(&dets[0].repr[0], ndets, detType,
+              commrank == 0 ? &recvDets[0].repr[0] : NULL, &recvcts[0],
+              &recvdisp[0], detType, 0, MPI_COMM_WORLD);
+  MPI_Type_free(&detType);
+  vector<Determinant>().swap(dets);
+
+  if (commrank == 0) {
+    recvDets.pop_back();
+    vector<vector<Determinant> > runs;
+    splitRuns(recvDets, recvcts, runs);
+    mergeSortedDets(runs, dets);
+  }
+}
+#endif
+
 double SHCIbasics::DoPerturbativeStochastic2SingleListDoubleEpsilon2AllTogether(
     Determinant* Dets, CItype* ci, int DetsSize, double& E0, oneInt& I1,
     twoInt& I2, twoIntHeatBathSHM& I2HB, vector<int>& irrep, schedule& schd,
@@ -194,6 +432,8 @@ double SHCIbasics::DoPerturbativeStochastic2SingleListDoubleEpsilon2AllTogether(
       MPI_Allreduce(&all_to_allCopy[0], &all_to_all[0], 2 * size * size,
                     MPI_INT, MPI_SUM, MPI_COMM_WORLD);
 #endif
+      if (schd.outputlevel > 0)
+        printOwnershipHistogram(all_to_all, size, "stochastic PT");
       vector<size_t> counter(size, 0);
       for (int i = 0; i < Det->size(); i++) {
         int toProc = hashValues[i] % size;
@@ -472,6 +712,8 @@ double SHCIbasics::DoPerturbativeDeterministic(
   SHMVecFromVecs(SortedDetsvec, SortedDets, shciSortedDets, SortedDetsSegment,
                  regionSortedDets);
   SortedDetsvec.clear();
+  DeterminantSet space;
+  space.make(SortedDets, DetsSize);
 
   double energyEN = 0.0;
   double Psi1NormProc = 0.0;
@@ -483,10 +725,17 @@ double SHCIbasics::DoPerturbativeDeterministic(
   int size = commsize, rank = commrank;
   vector<size_t> all_to_all(size * size, 0);
 
+  vector<double> cutoff(DetsSize);
+  for (int i = 0; i < DetsSize; i++) cutoff[i] = abs(schd.epsilon2 / ci[i]);
+  WorkDistribution work;
+  work.distribute(cutoff, I2HB, nelec);
+  cutoff.clear();
+  double workStart = getTime();
+
   if (schd.DoRDM || schd.doResponse) {
     uniqueDEH.extra_info = true;
-    for (int i = 0; i < DetsSize; i++) {
-      if (i % size != rank) continue;
+    for (int k = 0; k < work.mine.size(); k++) {
+      int i = work.mine[k];
       SHCIgetdeterminants::getDeterminantsDeterministicPTKeepRefDets(
           Dets[i], i, abs(schd.epsilon2 / ci[i]), ci[i], I1, I2, I2HB, irrep,
           coreE, E0, *uniqueDEH.Det, *uniqueDEH.Num, *uniqueDEH.Energy,
@@ -494,17 +743,30 @@ double SHCIbasics::DoPerturbativeDeterministic(
           *uniqueDEH.orbDifference_beforeMerge, schd, nelec);
     }
   } else {
-    for (int i = 0; i < DetsSize; i++) {
-      if ((i % size != rank)) continue;
-
-      SHCIgetdeterminants::getDeterminantsDeterministicPT(
-          Dets[i], abs(schd.epsilon2 / ci[i]), ci[i], 0.0, I1, I2, I2HB, irrep,
-          coreE, E0, *uniqueDEH.Det, *uniqueDEH.Num, *uniqueDEH.Energy, schd, 0,
-          nelec);
+    // the determinants of this rank are decoded a block at a time, their
+    // energies come from the diagonal cached by DoVariational
+    double* diag;
+    int diagSize = cachedDiagonal(diag);
+    OpenClosedBlock block;
+    const int blockSize = 256;
+    for (int first = 0; first < work.mine.size(); first += blockSize) {
+      int ndets = min(blockSize, (int)work.mine.size() - first);
+      block.decode(Dets, &work.mine[first], ndets, nelec);
+      for (int k = 0; k < ndets; k++) {
+        int i = work.mine[first + k];
+        double Energyd = i < diagSize ? diag[i] + coreE
+                                      : Dets[i].Energy(I1, I2, coreE);
+        SHCIgetdeterminants::getDeterminantsDeterministicPT(
+            Dets[i], abs(schd.epsilon2 / ci[i]), ci[i], 0.0, I1, I2, I2HB,
+            irrep, coreE, E0, *uniqueDEH.Det, *uniqueDEH.Num, *uniqueDEH.Energy,
+            schd, 0, nelec, block.getClosed(k), block.getOpen(k), Energyd);
+      }
       // if (i%100000 == 0 && omp_get_thread_num()==0 && commrank == 0) pout <<
       // "# " << i << endl;
     }
   }
+  work.busy = getTime() - workStart;
+  work.printBusyTime("deterministic PT");
 
   if (commsize > 1) {
     boost::shared_ptr<vector<Determinant> >& Det = uniqueDEH.Det;
@@ -543,6 +805,7 @@ double SHCIbasics::DoPerturbativeDeterministic(
     MPI_Allreduce(&all_to_allCopy[0], &all_to_all[0], 2 * size * size, MPI_INT,
                   MPI_SUM, MPI_COMM_WORLD);
 #endif
+    printOwnershipHistogram(all_to_all, size, "deterministic PT");
     vector<size_t> counter(size, 0);
     for (int i = 0; i < Det->size(); i++) {
       int toProc = hashValues[i] % size;
@@ -624,7 +887,7 @@ double SHCIbasics::DoPerturbativeDeterministic(
     uniqueDEH.Num2->clear();
   }
   uniqueDEH.MergeSortAndRemoveDuplicates();
-  uniqueDEH.RemoveDetsPresentIn(SortedDets, DetsSize);
+  uniqueDEH.RemoveDetsPresentIn(space);
 
   vector<Determinant>& hasHEDDets = *uniqueDEH.Det;
   vector<CItype>& hasHEDNumerator = *uniqueDEH.Num;
@@ -774,6 +1037,223 @@ void unpackTrevState(vector<Determinant>& Dets, int& DetsSize,
 #endif
 }
 
+// number of entries of the shared diagonal that are filled
+static int diagCacheSize = 0;
+
+//=============================================================================
+void SHCIbasics::extendDiagonal(Determinant* Dets, int oldSize, int newSize,
+                                oneInt& I1, twoInt& I2, double& coreE,
+                                double*& diag) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Keeps the diagonal elements <D_k|H|D_k> (without time reversal) of the
+  variational space in the node-shared DiagSegment. Only the determinants
+  oldSize..newSize-1 are evaluated, the entries of the earlier determinants are
+  kept from the previous calls. oldSize=0 starts a new cache.
+
+  :Inputs:
+
+      Determinant* Dets:
+          The shared-memory determinants of the basis
+      int oldSize:
+          Number of determinants already in the cache
+      int newSize:
+          Number of determinants after this call
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian
+      double& coreE:
+          The core energy
+      double*& diag:
+          Pointer to the shared diagonal (output)
+  */
+  //-----------------------------------------------------------------------------
+  int nNew = max(newSize - oldSize, 0);
+  vector<double> newDiag(nNew, 0.0);
+  for (int k = oldSize + commrank; k < newSize; k += commsize)
+    newDiag[k - oldSize] = Dets[k].Energy(I1, I2, coreE);
+
+#ifndef SERIAL
+  long maxint = 26843540;
+  for (long i = 0; i < nNew; i += maxint)
+    MPI_Allreduce(MPI_IN_PLACE, &newDiag[i], min(maxint, nNew - i), MPI_DOUBLE,
+                  MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+  // growing the segment keeps the entries that are already there
+  regionDiag = boost::interprocess::mapped_region();
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  if (localrank == 0) DiagSegment.truncate(max(newSize, 1) * sizeof(double));
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  regionDiag = boost::interprocess::mapped_region{
+      DiagSegment, boost::interprocess::read_write};
+  diag = static_cast<double*>(regionDiag.get_address());
+  if (localrank == 0)
+    for (int k = oldSize; k < newSize; k++) diag[k] = newDiag[k - oldSize];
+  diagCacheSize = newSize;
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+}  // end SHCIbasics::extendDiagonal
+
+//=============================================================================
+int SHCIbasics::cachedDiagonal(double*& diag) {
+  //-----------------------------------------------------------------------------
+  /*!
+  The diagonal left by the last DoVariational, for the determinants in the
+  order DoVariational returned them. It was computed with coreE = 0.
+
+  :Inputs:
+
+      double*& diag:
+          Pointer to the shared diagonal (output)
+
+  :Returns:
+
+      int size:
+          Number of cached entries (0 if there is no cache)
+  */
+  //-----------------------------------------------------------------------------
+  diag = diagCacheSize == 0 ? NULL
+                            : static_cast<double*>(regionDiag.get_address());
+  return diagCacheSize;
+}  // end SHCIbasics::cachedDiagonal
+
+//=============================================================================
+static double chooseEpsilon1(Determinant* Dets, CItype* cMax, int DetsSize,
+                             vector<double>& screenedAt, int iter,
+                             twoIntHeatBathSHM& I2HB, schedule& schd,
+                             int nelec,
+                             SHCImakeHamiltonian::SparseHam& sparseHam,
+                             SHCImakeHamiltonian::HamHelpers2& helper2,
+                             DeterminantSet& space, bool compactDets,
+                             double dedup, double& predicted) {
+  //-----------------------------------------------------------------------------
+  /*!
+  The epsilon1 of an iteration of the memoryBudget schedule. The new
+  determinants of a ladder of epsilon1, from the one of the last iteration
+  down to the last one of the schedule in steps of 2^(1/4), are counted
+  without making them, and the smallest epsilon1 is taken for which the space
+  grows at most growthFactor times and the memory per node stays within the
+  budget.
+
+  :Inputs:
+
+      Determinant* Dets:
+          The variational determinants
+      CItype* cMax:
+          Their selection coefficients
+      int DetsSize:
+          Number of variational determinants
+      vector<double>& screenedAt:
+          The smallest cutoff every determinant was screened with
+      int iter:
+          The iteration, larger than 0
+      twoIntHeatBathSHM& I2HB:
+          The sorted two-electron integrals
+      schedule& schd:
+          The schedule
+      int nelec:
+          Number of electrons
+      SparseHam& sparseHam:
+          The Hamiltonian of the current space, for its number of nonzeros
+      SHCImakeHamiltonian::HamHelpers2& helper2:
+          The helpers, to look up the space with compactDets
+      DeterminantSet& space:
+          The hash set of the space otherwise
+      bool compactDets:
+          Whether the determinants are looked up through the helpers
+      double dedup:
+          Fraction of the counted excitations that were distinct in the last
+          iteration
+      double& predicted:
+          Counted excitations for the chosen epsilon1 (output)
+
+  :Returns:
+
+      double epsilon1:
+          The chosen epsilon1
+  */
+  //-----------------------------------------------------------------------------
+  double floor = schd.epsilon1.back();
+  vector<double> epsilons(1, max(schd.epsilon1[iter - 1], floor));
+  while (epsilons.back() * pow(2., -0.25) > floor)
+    epsilons.push_back(epsilons.back() * pow(2., -0.25));
+  if (epsilons.back() > floor) epsilons.push_back(floor);
+  int neps = epsilons.size();
+
+  vector<size_t> counts(neps, 0);
+#pragma omp parallel
+  {
+    vector<size_t> threadCounts(neps, 0);
+#pragma omp for schedule(dynamic)
+    for (int i = commrank; i < DetsSize; i += commsize) {
+#ifndef Complex
+      double screened = screenedAt[i];
+#else
+      double screened = std::numeric_limits<double>::infinity();
+#endif
+      SHCIgetdeterminants::countDeterminantsVariationalApprox(
+          Dets[i], cMax[i], epsilons, I2HB, schd, nelec, screened,
+          threadCounts, compactDets ? &helper2 : NULL,
+          compactDets ? NULL : &space);
+    }
+#pragma omp critical
+    for (int k = 0; k < neps; k++) counts[k] += threadCounts[k];
+  }
+
+  // the current nonzeros per row and the number of nodes
+  size_t nnz = 0;
+  for (int i = 0; i < sparseHam.connections.size(); i++)
+    nnz += sparseHam.connections[i].size();
+  int nnodes = localrank == 0 ? 1 : 0;
+#ifndef SERIAL
+  MPI_Allreduce(MPI_IN_PLACE, &counts[0], neps, MPI_UNSIGNED_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &nnz, 1, MPI_UNSIGNED_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &nnodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+  // bytes per determinant on a node: the shared determinants, diagonal and
+  // helpers, the sorted copy and its hash set, the Davidson vectors and the
+  // rows of the Hamiltonian spread over the nodes
+  double perDet = sizeof(Determinant) + sizeof(double) + 4 * sizeof(int) +
+                  (schd.nroots + 4) * 2 * sizeof(CItype);
+  if (!compactDets) perDet += sizeof(Determinant) + 2 * sizeof(size_t);
+  if (schd.DavidsonType != DIRECT) {
+    double perElement = sizeof(int) + sizeof(CItype);
+    if (schd.DoRDM || schd.DoOneRDM) perElement += sizeof(size_t);
+    perDet += (1. * nnz / DetsSize * perElement +
+               3 * sizeof(vector<int>)) / nnodes;
+  }
+
+  int chosen = 0;
+  double cumulative = counts[0];
+  for (int k = 1; k < neps; k++) {
+    double size = DetsSize + dedup * (cumulative + counts[k]);
+    if (size > schd.growthFactor * DetsSize ||
+        size * perDet > schd.memoryBudget * 1.e9)
+      break;
+    cumulative += counts[k];
+    chosen = k;
+  }
+  predicted = cumulative;
+  double size = DetsSize + dedup * predicted;
+  if (size * perDet > schd.memoryBudget * 1.e9)
+    pout << "The memory budget is exceeded with the epsilon1 of the last "
+            "iteration" << endl;
+  pout << format("epsilon1 %10.2e  predicted determinants %10.0f  %8.2f GB "
+                 "per node") % epsilons[chosen] % size % (size * perDet / 1.e9)
+       << endl;
+  return epsilons[chosen];
+}  // end chooseEpsilon1
+
 // this takes in a ci vector for determinants placed in Dets
 // it then does a SHCI varitional calculation and the resulting
 // ci and dets are returned here
@@ -792,24 +1272,35 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
   boost::mpi::communicator world;
 #endif
 
+  // with the compact encoding the space is looked up through the helpers and
+  // the sorted copy of the determinants is never made
+  bool compactDets = schd.compactDets;
+#ifdef Complex
+  compactDets = false;  // updateSOCconnections needs the sorted determinants
+#endif
+
   // Put determinants on the shared memory
-  Determinant *SHMDets, *SortedDets;
+  Determinant *SHMDets, *SortedDets = NULL;
   SHMVecFromVecs(Dets, SHMDets, shciDetsCI, DetsCISegment, regionDetsCI);
   if (proc != 0) Dets.resize(0);
   std::vector<Determinant> SortedDetsvec;  // only proc 1 has it
-  if (commrank == 0) {
+  if (commrank == 0 && !compactDets) {
     SortedDetsvec = Dets;
     std::sort(SortedDetsvec.begin(), SortedDetsvec.end());
   }
-  int SortedDetsSize = SortedDetsvec.size(), DetsSize = Dets.size();
-  SHMVecFromVecs(SortedDetsvec, SortedDets, shciSortedDets, SortedDetsSegment,
-                 regionSortedDets);
+  int SortedDetsSize = Dets.size(), DetsSize = Dets.size();
+  if (!compactDets)
+    SHMVecFromVecs(SortedDetsvec, SortedDets, shciSortedDets,
+                   SortedDetsSegment, regionSortedDets);
   Dets.clear();
   SortedDetsvec.clear();
 #ifndef SERIAL
   mpi::broadcast(world, SortedDetsSize, 0);
   mpi::broadcast(world, DetsSize, 0);
 #endif
+  // the hash set of SortedDets, remade whenever they are
+  DeterminantSet space;
+  if (!compactDets) space.make(SortedDets, SortedDetsSize);
 
   // sometimes coreenergy is huge and it kills the stability of davidson solver
   // so make it zero and just add it to the converged energy
@@ -832,6 +1323,8 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
   }
 
   MatrixXx diag;
+  double* SHMdiag;
+  int diagSize = 0;
 
   size_t norbs = 2. * I2.Direct.rows();
   int Norbs = norbs;
@@ -847,11 +1340,17 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     helper2.PopulateHelpers(SHMDets, DetsSize, 0);
   }
   helper2.MakeSHMHelpers();
+  if (compactDets) helper2.MakeSHMStrings();
+
+  // the diagonal is computed once per determinant and extended as the space
+  // grows
+  extendDiagonal(SHMDets, 0, DetsSize, I1, I2, coreE, SHMdiag);
+  diagSize = DetsSize;
 
   // if it is not direct Hamiltonian then generate it
   if (schd.DavidsonType != DIRECT) {
     sparseHam.makeFromHelper(helper2, SHMDets, 0, DetsSize, Norbs, I1, I2,
-                             coreE, schd.DoRDM || schd.DoOneRDM);
+                             coreE, schd.DoRDM || schd.DoOneRDM, SHMdiag);
   }
 
   // update the Hamiltonian with SOC terms
@@ -880,26 +1379,33 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     SortedDetsSize = DetsSize;
 
     // put sorted dets on shared memory as well
-    SHMVecFromVecs(Dets, SortedDets, shciSortedDets, SortedDetsSegment,
-                   regionSortedDets);
+    if (!compactDets)
+      SHMVecFromVecs(Dets, SortedDets, shciSortedDets, SortedDetsSegment,
+                     regionSortedDets);
 #ifndef SERIAL
     mpi::broadcast(world, SortedDetsSize, 0);
     mpi::broadcast(world, DetsSize, 0);
 #endif
-    if (localrank == 0) std::sort(SortedDets, SortedDets + SortedDetsSize);
+    if (localrank == 0 && !compactDets)
+      std::sort(SortedDets, SortedDets + SortedDetsSize);
 #ifndef SERIAL
     MPI_Barrier(MPI_COMM_WORLD);
 #endif
+    if (!compactDets) space.make(SortedDets, SortedDetsSize);
     Dets.clear();
 
+    extendDiagonal(SHMDets, 0, DetsSize, I1, I2, coreE, SHMdiag);
+    diagSize = DetsSize;
+
     // Make helpers and make sparse hamiltonian if full restart and not direct
     helper2.MakeSHMHelpers();
+    if (compactDets) helper2.MakeSHMStrings();
     if (!(schd.DavidsonType == DIRECT ||
           (!schd.fullrestart && converged &&
            iterstart >= schd.epsilon1.size() - 1))) {
       sparseHam.clear();
       sparseHam.makeFromHelper(helper2, SHMDets, 0, DetsSize, Norbs, I1, I2,
-                               coreE, schd.DoRDM || schd.DoOneRDM);
+                               coreE, schd.DoRDM || schd.DoOneRDM, SHMdiag);
     }
 
     for (int i = 0; i < E0.size(); i++)
@@ -932,6 +1438,14 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     }
   }
 
+  // the smallest cutoff every determinant was screened with, the same on all
+  // ranks, the determinants above it are in the space already
+  vector<double> screenedAt(SortedDetsSize,
+                            std::numeric_limits<double>::infinity());
+  // with the memoryBudget schedule, the fraction of the counted excitations
+  // that were distinct, learnt from iteration to iteration
+  double dedup = 1., predicted = 0.;
+
   for (int iter = iterstart; iter < schd.epsilon1.size(); iter++) {
     double epsilon1 = schd.epsilon1[iter];
     StitchDEH uniqueDEH;
@@ -954,95 +1468,91 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     SHMVecFromVecs(cMax, cMaxSHM, shcicMax, cMaxSegment, regioncMax);
     cMax.clear();
 
+    int previousSize = DetsSize;
+    if (schd.memoryBudget > 0 && iter > 0) {
+      epsilon1 = chooseEpsilon1(SHMDets, cMaxSHM, DetsSize, screenedAt, iter,
+                                I2HB, schd, nelec, sparseHam, helper2, space,
+                                compactDets, dedup, predicted);
+      schd.epsilon1[iter] = epsilon1;
+    }
+
     CItype zero = 0.0;
 
-    for (int i = 0; i < SortedDetsSize; i++) {
-      if (i % (commsize) != commrank) continue;
+    // the determinants of this rank are split over the OpenMP threads, most
+    // expensive first, which collect, sort and deduplicate their candidates
+    // separately before they are merged
+    vector<double> cutoff(SortedDetsSize);
+    for (int i = 0; i < SortedDetsSize; i++)
+      cutoff[i] = epsilon1 / abs(cMaxSHM[i]);
+    WorkDistribution work;
 #ifndef Complex
-      SHCIgetdeterminants::getDeterminantsVariationalApprox(
-          SHMDets[i], epsilon1 / abs(cMaxSHM[i]), cMaxSHM[i], zero, I1, I2,
-          I2HB, irrep, coreE, E0[0], *uniqueDEH.Det, schd, 0, nelec, SortedDets,
-          SortedDetsSize);
+    work.distribute(cutoff, I2HB, nelec, &screenedAt);
+#else
+    work.distribute(cutoff, I2HB, nelec);
+#endif
+    double selectionStart = getTime();
+
+    vector<vector<Determinant> > threadDets(omp_get_max_threads());
+    long nowned = work.mine.size();
+#pragma omp parallel
+    {
+      vector<Determinant>& dets = threadDets[omp_get_thread_num()];
+#pragma omp for schedule(dynamic)
+      for (long k = 0; k < nowned; k++) {
+        int i = work.mine[k];
+#ifndef Complex
+        SHCIgetdeterminants::getDeterminantsVariationalApprox(
+            SHMDets[i], epsilon1 / abs(cMaxSHM[i]), cMaxSHM[i], zero, I1, I2,
+            I2HB, irrep, coreE, E0[0], dets, schd, 0, nelec, SortedDets,
+            SortedDetsSize, compactDets ? &helper2 : NULL, screenedAt[i],
+            compactDets ? NULL : &space);
 
 #else
-      SHCIgetdeterminants::getDeterminantsVariational(
-          SHMDets[i], epsilon1 / abs(cMaxSHM[i]), cMaxSHM[i], zero, I1, I2,
-          I2HB, irrep, coreE, E0[0], *uniqueDEH.Det, schd, 0, nelec);
+        SHCIgetdeterminants::getDeterminantsVariational(
+            SHMDets[i], epsilon1 / abs(cMaxSHM[i]), cMaxSHM[i], zero, I1, I2,
+            I2HB, irrep, coreE, E0[0], dets, schd, 0, nelec);
 #endif
-    }
+      }
 
-    if (Determinant::Trev != 0) {
-      for (int i = 0; i < uniqueDEH.Det->size(); i++)
-        uniqueDEH.Det->at(i).makeStandard();
+      if (Determinant::Trev != 0) {
+        for (int i = 0; i < dets.size(); i++) dets[i].makeStandard();
+      }
+      sort(dets.begin(), dets.end());
+      dets.erase(unique(dets.begin(), dets.end()), dets.end());
     }
+    work.busy = getTime() - selectionStart;
+    if (schd.outputlevel > 0) work.printBusyTime("selection");
+    for (int i = 0; i < SortedDetsSize; i++)
+      screenedAt[i] = min(screenedAt[i], cutoff[i]);
+    cutoff.clear();
 
     //*********
-    // Remove duplicates and put all the dets on all the nodes
+    // Remove duplicates: every determinant is sent to the rank that owns its
+    // hash, which merges the candidates of all ranks and removes the ones
+    // already in the variational space, and rank 0 gathers what is left
 
-    sort(uniqueDEH.Det->begin(), uniqueDEH.Det->end());
-    uniqueDEH.Det->erase(unique(uniqueDEH.Det->begin(), uniqueDEH.Det->end()),
-                         uniqueDEH.Det->end());
+    mergeSortedDets(threadDets, *uniqueDEH.Det);
+#ifndef SERIAL
+    if (commsize > 1) sendDetsToOwners(*uniqueDEH.Det, schd.outputlevel > 0);
+#endif
 
-    if (Determinant::Trev != 0)
-      uniqueDEH.RemoveOnlyDetsPresentIn(SortedDets, SortedDetsSize);
+    if (Determinant::Trev != 0 && compactDets) {
+      vector<Determinant>& newDets = *uniqueDEH.Det;
+      newDets.erase(remove_if(newDets.begin(), newDets.end(),
+                              [&](Determinant& d) {
+                                return helper2.contains(d);
+                              }),
+                    newDets.end());
+    } else if (Determinant::Trev != 0)
+      uniqueDEH.RemoveOnlyDetsPresentIn(space);
 #ifdef Complex
-    uniqueDEH.RemoveOnlyDetsPresentIn(SortedDets, SortedDetsSize);
+    uniqueDEH.RemoveOnlyDetsPresentIn(space);
 #endif
 
 #ifndef SERIAL
-    for (int level = 0; level < ceil(log2(nprocs)); level++) {
-      if (proc % ipow(2, level + 1) == 0 && proc + ipow(2, level) < nprocs) {
-        int getproc = proc + ipow(2, level);
-        long numDets = 0;
-        long oldSize = uniqueDEH.Det->size();
-        long maxint = 26843540;
-        MPI_Recv(&numDets, 1, MPI_DOUBLE, getproc, getproc, MPI_COMM_WORLD,
-                 MPI_STATUS_IGNORE);
-        long totalMemory = numDets * DetLen;
-
-        if (totalMemory != 0) {
-          uniqueDEH.Det->resize(oldSize + numDets);
-          for (int i = 0; i < (totalMemory / maxint); i++)
-            MPI_Recv(&(uniqueDEH.Det->at(oldSize).repr[0]) + i * maxint, maxint,
-                     MPI_DOUBLE, getproc, getproc, MPI_COMM_WORLD,
-                     MPI_STATUS_IGNORE);
-          MPI_Recv(&(uniqueDEH.Det->at(oldSize).repr[0]) +
-                       (totalMemory / maxint) * maxint,
-                   totalMemory - (totalMemory / maxint) * maxint, MPI_DOUBLE,
-                   getproc, getproc, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-          sort(uniqueDEH.Det->begin(), uniqueDEH.Det->end());
-          uniqueDEH.Det->erase(
-              unique(uniqueDEH.Det->begin(), uniqueDEH.Det->end()),
-              uniqueDEH.Det->end());
-        }
-
-      } else if (proc % ipow(2, level + 1) == 0 &&
-                 proc + ipow(2, level) >= nprocs) {
-        continue;
-      } else if (proc % ipow(2, level) == 0) {
-        int toproc = proc - ipow(2, level);
-        int proc = commrank;
-        long numDets = uniqueDEH.Det->size();
-        long maxint = 26843540;
-        long totalMemory = numDets * DetLen;
-        MPI_Send(&numDets, 1, MPI_DOUBLE, toproc, proc, MPI_COMM_WORLD);
-
-        if (totalMemory != 0) {
-          for (int i = 0; i < (totalMemory / maxint); i++)
-            MPI_Send(&(uniqueDEH.Det->at(0).repr[0]) + i * maxint, maxint,
-                     MPI_DOUBLE, toproc, proc, MPI_COMM_WORLD);
-          MPI_Send(
-              &(uniqueDEH.Det->at(0).repr[0]) + (totalMemory / maxint) * maxint,
-              totalMemory - (totalMemory / maxint) * maxint, MPI_DOUBLE, toproc,
-              proc, MPI_COMM_WORLD);
-          uniqueDEH.clear();
-        }
-      }
-    }
-    //*************
-
+    if (commsize > 1) gatherDetsOnRoot(*uniqueDEH.Det);
 #endif
+    //*************
 
     //**********
     // Resize X0 and dets and sorteddets
@@ -1069,28 +1579,38 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
 #ifndef SERIAL
     mpi::broadcast(world, DetsSize, 0);
 #endif
+    screenedAt.resize(DetsSize, std::numeric_limits<double>::infinity());
+    if (schd.memoryBudget > 0 && iter > 0 && predicted > 0)
+      dedup = min(1., (DetsSize - previousSize) / predicted);
     //************
     if (commrank == 0 && schd.DavidsonType == DIRECT)
       printf("New size of determinant space %8i\n", DetsSize);
 
+    // only the new determinants need their diagonal elements
+    extendDiagonal(SHMDets, diagSize, DetsSize, I1, I2, coreE, SHMdiag);
+    diagSize = DetsSize;
+
     //*************
     // make Helpers and Hamiltonian
     if (proc == 0) {
       helper2.PopulateHelpers(SHMDets, DetsSize, SortedDetsSize);
     }
     helper2.MakeSHMHelpers();
+    if (compactDets) helper2.MakeSHMStrings();
     if (schd.DavidsonType != DIRECT) {
       sparseHam.makeFromHelper(helper2, SHMDets, SortedDetsSize, DetsSize,
                                Norbs, I1, I2, coreE,
-                               schd.DoRDM || schd.DoOneRDM);
+                               schd.DoRDM || schd.DoOneRDM, SHMdiag);
     }
     //************
 
     // we update the sharedvectors after Hamiltonian is formed because needed
     // the dets size from previous iterations
-    SHMVecFromVecs(SHMDets, DetsSize, SortedDets, shciSortedDets,
-                   SortedDetsSegment, regionSortedDets);
-    if (localrank == 0) std::sort(SortedDets, SortedDets + DetsSize);
+    if (!compactDets) {
+      SHMVecFromVecs(SHMDets, DetsSize, SortedDets, shciSortedDets,
+                     SortedDetsSegment, regionSortedDets);
+      if (localrank == 0) std::sort(SortedDets, SortedDets + DetsSize);
+    }
 #ifndef SERIAL
     MPI_Barrier(MPI_COMM_WORLD);
 #endif
@@ -1105,6 +1625,7 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
 #ifndef SERIAL
     mpi::broadcast(world, SortedDetsSize, 0);
 #endif
+    if (!compactDets) space.make(SortedDets, SortedDetsSize);
 
     // MERGE 2018.07.13, don't know where that comes from, commenting it
     // if (proc == 0) {
@@ -1133,14 +1654,8 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     // Make the diagonal elements so that preconditioner can be applied in
     // davidson
     if (proc == 0) {
-      MatrixXx diagbkp = diag;
       diag = MatrixXx::Zero(DetsSize, 1);
-      for (int k = 0; k < diagbkp.rows(); k++) diag(k, 0) = diagbkp(k, 0);
-
-      for (size_t k = diagbkp.rows(); k < DetsSize; k++) {
-        CItype hij = SHMDets[k].Energy(I1, I2, coreE);
-        diag(k, 0) = hij;
-      }
+      for (int k = 0; k < DetsSize; k++) diag(k, 0) = SHMdiag[k];
     }
 
     // Hmult has a operator() that lets you multiply a vector with H to generate
@@ -1149,7 +1664,7 @@ vector<double> SHCIbasics::DoVariational(vector<MatrixXx>& ci,
     if (iter == 0) prevE0 = -10.0;
     Hmult2 H(sparseHam);
     HmultDirect Hdirect(helper2, SHMDets, DetsSize, 0, Norbs, I1, I2, coreE,
-                        diag);
+                        diag, SHMdiag);
     if (schd.DavidsonType == DISK) sparseHam.setNbatches(DetsSize);
     int numIter = 0;
 
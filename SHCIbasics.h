@@ -86,6 +86,11 @@ void readVariationalResult(int& iter, vector<MatrixXx>& ci,
                            vector<double>& E0, bool& converged, schedule& schd,
                            std::map<HalfDet, std::vector<int> >& BetaN,
                            std::map<HalfDet, std::vector<int> >& AlphaNm1);
+void extendDiagonal(Determinant* Dets, int oldSize, int newSize, oneInt& I1,
+                    twoInt& I2, double& coreE, double*& diag);
+
+int cachedDiagonal(double*& diag);
+
 vector<double> DoVariational(vector<MatrixXx>& ci, vector<Determinant>& Dets,
                              schedule& schd, twoInt& I2,
                              twoIntHeatBathSHM& I2HB, vector<int>& irrep,
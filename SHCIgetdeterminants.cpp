@@ -33,6 +33,26 @@ using namespace std;
 using namespace Eigen;
 using namespace boost;
 
+// the first index in [start, end) of a heat bath list below eps, the list is
+// sorted by magnitude so a galloping search costs the logarithm of the number
+// of entries skipped
+static size_t firstBelow(twoIntHeatBathSHM& I2hb, float* integrals,
+                         compactHeatBathEntry* entries, size_t start, size_t end,
+                         double eps, unsigned short bucket) {
+  size_t last = start, step = 1;
+  while (last < end && !I2hb.below(integrals, entries, last, eps, bucket)) {
+    start = last+1;
+    last = start+step;
+    step *= 2;
+  }
+  last = min(last, end);
+  while (start < last) {
+    size_t mid = start + (last-start)/2;
+    if (I2hb.below(integrals, entries, mid, eps, bucket)) last = mid;
+    else start = mid+1;
+  }
+  return start;
+}
 
 
 //=============================================================================
@@ -83,15 +103,48 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPT(
     */
 //-----------------------------------------------------------------------------
 
+  int norbs = d.norbs;
+  vector<int> closed(nelec,0);
+  vector<int> open(norbs-nelec+1,0);
+  d.getOpenClosed(&open[0], &closed[0]);
+  getDeterminantsDeterministicPT(d, epsilon, ci1, ci2, int1, int2, I2hb, irreps,
+                                 coreE, E0, dets, numerator, energy, schd, Nmc,
+                                 nelec, &closed[0], &open[0],
+                                 d.Energy(int1, int2, coreE));
+} // end SHCIgetdeterminants::getDeterminantsDeterministicPT
+
+
+
+//=============================================================================
+void SHCIgetdeterminants::getDeterminantsDeterministicPT(
+        Determinant& d, double epsilon, CItype ci1, CItype ci2,
+        oneInt& int1, twoInt& int2, twoIntHeatBathSHM& I2hb,
+        vector<int>& irreps, double coreE, double E0,
+        std::vector<Determinant>& dets, std::vector<CItype>& numerator, std::vector<double>& energy,
+        schedule& schd, int Nmc, int nelec, int* closed, int* open,
+        double Energyd) {
+//-----------------------------------------------------------------------------
+    /*!
+    Same as above, with the closed and open orbitals of d already decoded
+    (e.g. by OpenClosedBlock) so that no per-determinant allocation is needed,
+    and the diagonal energy of d given (e.g. from the cached diagonal)
+
+    :Inputs:
+
+        int* closed:
+            The nelec occupied orbitals of d
+        int* open:
+            The norbs-nelec empty orbitals of d
+        double Energyd:
+            The diagonal energy <d|H|d>, including coreE
+    */
+//-----------------------------------------------------------------------------
+
   // initialize variables
   int norbs   = d.norbs;
   int nclosed = nelec;
   int nopen   = norbs-nclosed;
-  vector<int> closed(nelec,0);
-  vector<int> open(norbs-nelec,0);
-  d.getOpenClosed(open, closed);
   //d.getRepArray(detArray);
-  double Energyd = d.Energy(int1, int2, coreE);
 
   // mono-excited determinants
   for (int ia=0; ia<nopen*nclosed; ia++){
@@ -114,11 +167,7 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPT(
 
       // numerator and energy
       numerator.push_back(integral*ci1);
-#ifndef Complex
       double E = EnergyAfterExcitation(closed, nclosed, int1, int2, coreE, i, open[a], Energyd);
-#else
-      double E = di.Energy(int1, int2, coreE);
-#endif
       energy.push_back(E);
     }
   } // ia
@@ -126,6 +175,7 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPT(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -138,14 +188,15 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPT(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (!(d.getocc(a) || d.getocc(b))) {
         dets.push_back(d);
         Determinant& di = *dets.rbegin();
@@ -260,6 +311,7 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPTKeepRefDets(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -272,14 +324,15 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPTKeepRefDets(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (!(det.getocc(a) || det.getocc(b))) {
         dets.push_back(det);
         Determinant& di = *dets.rbegin();
@@ -395,8 +448,6 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPTWithSOC(
       if(fabs(integral) > epsilon2) numerator2.push_back(integral*ci2);
       else numerator2.push_back(0.0);
       double E = EnergyAfterExcitation(closed, nclosed, int1, int2, coreE, i, open[a], Energyd);
-      //double E = Energyd - int1(closed[i], closed[i]) + int1(open[a],open[a]);
-      if (closed[i]%2 != open[a]%2) E = di.Energy(int1, int2, coreE);
       energy.push_back(E);
     }
   } // ia
@@ -404,6 +455,8 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPTWithSOC(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) < epsilon1 && fabs(int2.maxEntry) < epsilon2) return;
+  double epsilonMin = min(epsilon1, epsilon2);
+  unsigned short bucket = heatBathMagnitude(epsilonMin);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -416,14 +469,15 @@ void SHCIgetdeterminants::getDeterminantsDeterministicPTWithSOC(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon1 && fabs(integrals[index]) < epsilon2) break;
+      if (I2hb.below(integrals, entries, index, epsilonMin, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (!(det.getocc(a) || det.getocc(b))) {
         dets.push_back(det);
         Determinant& di = *dets.rbegin();
@@ -527,6 +581,7 @@ void SHCIgetdeterminants::getDeterminantsVariational(
 
   // bi-excitated determinants
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -541,14 +596,15 @@ void SHCIgetdeterminants::getDeterminantsVariational(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (a/2 >= schd.ncore+schd.nact || b/2 >= schd.ncore+schd.nact) continue;
       if (!(d.getocc(a) || d.getocc(b))) {
         dets.push_back(d);
@@ -570,7 +626,9 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
         vector<int>& irreps, double coreE, double E0,
         std::vector<Determinant>& dets,
         schedule& schd, int Nmc, int nelec,
-        Determinant* SortedDets, int SortedDetsSize) {
+        Determinant* SortedDets, int SortedDetsSize,
+        SHCImakeHamiltonian::HamHelpers2* helpers, double screened,
+        SHCISortMpiUtils::DeterminantSet* space) {
 //-----------------------------------------------------------------------------
     /*!
     Make the int represenation of open and closed orbitals of determinant
@@ -610,9 +668,21 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
             The sorted list of determinants
         int SortedDetsSize:
             The number of unique determinants
+        SHCImakeHamiltonian::HamHelpers2* helpers:
+            If not NULL, the current space is looked up in its compact
+            (alpha, beta) encoding and SortedDets is not used
+        double screened:
+            The smallest criterion d was screened with before, the
+            determinants above it are already in the space and only the
+            ones between epsilon and screened are made
+        SHCISortMpiUtils::DeterminantSet* space:
+            If not NULL, the current space is looked up in this hash set of
+            SortedDets instead of binary searching it
     */
 //-----------------------------------------------------------------------------
 
+  if (screened <= epsilon) return;
+
   // initialize variables
   int norbs = d.norbs;
   int nclosed = nelec;
@@ -621,12 +691,19 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
   vector<int> open(norbs-nelec,0);
   d.getOpenClosed(open, closed);
   int unpairedElecs = schd.enforceSeniority ?  d.numUnpairedElectrons() : 0;
+  auto present = [&](Determinant& di) {
+    if (helpers != NULL) return helpers->contains(di);
+    if (space != NULL) return space->contains(di);
+    return binary_search(SortedDets, SortedDets+SortedDetsSize, di);
+  };
 
   // mono-excited determinants
   for (int ia=0; ia<nopen*nclosed; ia++){
     int i=ia/nopen, a=ia%nopen;
     if (closed[i]/2 < schd.ncore || open[a]/2 >= schd.ncore+schd.nact) continue;
     CItype integral = I2hb.Singles(open[a], closed[i]);//Hij_1Excite(open[a],closed[i],int1,int2, &closed[0], nclosed);
+    // the test of the screening with screened
+    bool boundAboveScreened = fabs(integral) > screened;
 
     if (fabs(integral) > epsilon)
       if (closed[i]%2 == open[a]%2)
@@ -634,7 +711,7 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
 
     // generate determinant if integral is above the criterion
     //if (fabs(integral/(E0-Energyd)) > epsilon ) {
-    if (fabs(integral) > epsilon ) {
+    if (fabs(integral) > epsilon && !(boundAboveScreened && fabs(integral) > screened)) {
       Determinant di = d;
       di.setocc(open[a], true); di.setocc(closed[i],false);
 
@@ -650,17 +727,19 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
       //  continue;
       //}
 
-      if (!binary_search(SortedDets, SortedDets+SortedDetsSize, di)) dets.push_back(di);
+      if (!present(di)) dets.push_back(di);
 #ifdef Complex
       Determinant detcpy = di;
       detcpy.flipAlphaBeta();
-      if (!binary_search(SortedDets, SortedDets+SortedDetsSize, detcpy)) dets.push_back(detcpy);
+      if (!present(detcpy)) dets.push_back(detcpy);
 #endif
     }
   } // ia
 
   // bi-excitated determinants
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
+  unsigned short screenedBucket = heatBathMagnitude(screened);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -675,14 +754,19 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
+
+    // skip the integrals above screened
+    if (screened != std::numeric_limits<double>::infinity())
+      start = firstBelow(I2hb, integrals, entries, start, end, screened, screenedBucket);
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       //double E = EnergyAfterExcitation(closed, nclosed, int1, int2, coreE, i, a, j, b, Energyd);
       //if (abs(integrals[index]/(E0-Energyd)) <epsilon) continue;
       if (a/2 >= schd.ncore+schd.nact || b/2 >= schd.ncore+schd.nact) continue;
@@ -700,11 +784,11 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
         //  continue;
         //}
 
-        if (!binary_search(SortedDets, SortedDets+SortedDetsSize, di)) dets.push_back(di);
+        if (!present(di)) dets.push_back(di);
 #ifdef Complex
         Determinant detcpy = di;
         detcpy.flipAlphaBeta();
-        if (!binary_search(SortedDets, SortedDets+SortedDetsSize, detcpy)) dets.push_back(detcpy);
+        if (!present(detcpy)) dets.push_back(detcpy);
 #endif
 
         //if (Determinant::Trev != 0) di.makeStandard();
@@ -715,6 +799,117 @@ void SHCIgetdeterminants::getDeterminantsVariationalApprox(
 } // end SHCIgetdeterminants::getDeterminantsVariationalApprox
 
 
+//=============================================================================
+void SHCIgetdeterminants::countDeterminantsVariationalApprox(
+        Determinant& d, CItype ci, const vector<double>& epsilons,
+        twoIntHeatBathSHM& I2hb, schedule& schd, int nelec,
+        double screened, vector<size_t>& counts,
+        SHCImakeHamiltonian::HamHelpers2* helpers,
+        SHCISortMpiUtils::DeterminantSet* space) {
+//-----------------------------------------------------------------------------
+    /*!
+    Counts the excitations getDeterminantsVariationalApprox would make from d
+    for several epsilon1 at once, without keeping them. The singles use the
+    bound of I2hb.Singles and the excitations reached from several references
+    are counted for each of them, so the counts are an upper bound.
+
+    :Inputs:
+
+        Determinant& d:
+            The reference |D_i>
+        CItype ci:
+            The reference CI coefficient c_i
+        const vector<double>& epsilons:
+            The epsilon1 to count for, decreasing
+        twoIntHeatBathSHM& I2hb:
+            The sorted two-electron integrals
+        schedule& schd:
+            The schedule
+        int nelec:
+            Number of electrons
+        double screened:
+            The smallest criterion d was screened with before, as in
+            getDeterminantsVariationalApprox
+        vector<size_t>& counts:
+            counts[k] is increased by the number of excitations made with
+            epsilons[k] but not with epsilons[k-1] (output)
+        SHCImakeHamiltonian::HamHelpers2* helpers:
+            With the compact determinants, the helpers to look up the space
+        SHCISortMpiUtils::DeterminantSet* space:
+            Otherwise the hash set of the space, excitations in the space are
+            not counted (no lookup if both are NULL)
+    */
+//-----------------------------------------------------------------------------
+  int norbs = d.norbs;
+  int nclosed = nelec;
+  int nopen = norbs-nclosed;
+  vector<int> closed(nelec,0);
+  vector<int> open(norbs-nelec,0);
+  d.getOpenClosed(open, closed);
+  int neps = epsilons.size();
+  double c = abs(ci);
+  double epsilonMin = epsilons[neps-1]/c;
+  if (screened <= epsilonMin) return;
+
+  auto present = [&](Determinant& di) {
+    if (helpers != NULL) return helpers->contains(di);
+    if (space != NULL) return space->contains(di);
+    return false;
+  };
+
+  // the first k for which the criterion passes epsilons[k]/|c|
+  auto first = [&](double integral) {
+    int k = 0;
+    while (k < neps-1 && fabs(integral) < epsilons[k]/c) k++;
+    return k;
+  };
+
+  for (int ia=0; ia<nopen*nclosed; ia++) {
+    int i=ia/nopen, a=ia%nopen;
+    if (closed[i]/2 < schd.ncore || open[a]/2 >= schd.ncore+schd.nact) continue;
+    double integral = fabs(I2hb.Singles(open[a], closed[i]));
+    if (integral > epsilonMin && !(integral > screened)) {
+      Determinant di = d;
+      di.setocc(open[a], true); di.setocc(closed[i],false);
+      if (!present(di)) counts[first(integral)]++;
+    }
+  }
+
+  unsigned short bucket = heatBathMagnitude(epsilonMin);
+  unsigned short screenedBucket = heatBathMagnitude(screened);
+  for (int ij=0; ij<nclosed*nclosed; ij++) {
+    int i=ij/nclosed, j = ij%nclosed;
+    if (i<=j) continue;
+    int I = closed[i]/2, J = closed[j]/2;
+    int X = max(I, J), Y = min(I, J);
+    if (closed[i]/2 < schd.ncore || closed[j]/2 < schd.ncore) continue;
+
+    int pairIndex = X*(X+1)/2+Y;
+    size_t start = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex]   : I2hb.startingIndicesOppositeSpin[pairIndex];
+    size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
+    float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
+    short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
+
+    if (screened != std::numeric_limits<double>::infinity())
+      start = firstBelow(I2hb, integrals, entries, start, end, screened, screenedBucket);
+
+    // the list is sorted, so k only grows along it
+    int k = 0;
+    for (size_t index=start; index<end; index++) {
+      if (I2hb.below(integrals, entries, index, epsilonMin, bucket)) break;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
+      if (a/2 >= schd.ncore+schd.nact || b/2 >= schd.ncore+schd.nact) continue;
+      if (d.getocc(a) || d.getocc(b)) continue;
+      while (k < neps-1 && fabs(integrals[index]) < epsilons[k]/c) k++;
+      Determinant di = d;
+      di.setocc(a, true); di.setocc(b, true);di.setocc(closed[i],false); di.setocc(closed[j], false);
+      if (!present(di)) counts[k]++;
+    }
+  }
+} // end SHCIgetdeterminants::countDeterminantsVariationalApprox
+
+
 
 //=============================================================================
 void SHCIgetdeterminants::getDeterminantsStochastic(
@@ -799,11 +994,7 @@ void SHCIgetdeterminants::getDeterminantsStochastic(
 #else
       numerator2.push_back( (integral*integral*ci1*(ci1*Nmcd/(Nmcd-1)- ci2)).real());
 #endif
-#ifndef Complex
       double E = EnergyAfterExcitation(closed, nclosed, int1, int2, coreE, i, open[a], Energyd);
-#else
-      double E = di.Energy(int1, int2, coreE);
-#endif
       energy.push_back(E);
     }
   } // ia
@@ -811,6 +1002,7 @@ void SHCIgetdeterminants::getDeterminantsStochastic(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -823,14 +1015,15 @@ void SHCIgetdeterminants::getDeterminantsStochastic(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (!(d.getocc(a) || d.getocc(b))) {
         dets.push_back(d);
         Determinant& di = *dets.rbegin();
@@ -948,11 +1141,7 @@ void SHCIgetdeterminants::getDeterminantsStochastic2Epsilon(
       numerator2A.push_back( pow( abs(integral*ci1),2)*Nmcd/(Nmcd-1) *(1. - abs(ci2)/abs(ci1)) );
       //numerator2A.push_back( (integral*integral*ci1 *(ci1*Nmcd/(Nmcd-1)- ci2)).real() );
 #endif
-#ifndef Complex
       double E = EnergyAfterExcitation(closed, nclosed, int1, int2, coreE, i, open[a], Energyd);
-#else
-      double E = di.Energy(int1, int2, coreE);
-#endif
       energy.push_back(E);
 
       // ...
@@ -964,6 +1153,7 @@ void SHCIgetdeterminants::getDeterminantsStochastic2Epsilon(
   // bi-excitated determinants
   //#pragma omp parallel for schedule(dynamic)
   if (fabs(int2.maxEntry) < epsilon) return;
+  unsigned short bucket = heatBathMagnitude(epsilon);
   // for all pairs of closed
   for (int ij=0; ij<nclosed*nclosed; ij++) {
     int i=ij/nclosed, j = ij%nclosed;
@@ -976,14 +1166,15 @@ void SHCIgetdeterminants::getDeterminantsStochastic2Epsilon(
     size_t end   = closed[i]%2==closed[j]%2 ? I2hb.startingIndicesSameSpin[pairIndex+1] : I2hb.startingIndicesOppositeSpin[pairIndex+1];
     float* integrals  = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinIntegrals : I2hb.oppositeSpinIntegrals;
     short* orbIndices = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinPairs     : I2hb.oppositeSpinPairs;
+    compactHeatBathEntry* entries = closed[i]%2==closed[j]%2 ?  I2hb.sameSpinEntries : I2hb.oppositeSpinEntries;
 
     // for all HCI integrals
     for (size_t index=start; index<end; index++) {
       // if we are going below the criterion, break
-      if (fabs(integrals[index]) < epsilon) break;
+      if (I2hb.below(integrals, entries, index, epsilon, bucket)) break;
 
       // otherwise: generate the determinant corresponding to the current excitation
-      int a = 2* orbIndices[2*index] + closed[i]%2, b= 2*orbIndices[2*index+1]+closed[j]%2;
+      int a = 2*I2hb.orbital(orbIndices, entries, index, 0) + closed[i]%2, b = 2*I2hb.orbital(orbIndices, entries, index, 1) + closed[j]%2;
       if (!(d.getocc(a) || d.getocc(b))) {
         dets.push_back(d);
         Determinant& di = *dets.rbegin();
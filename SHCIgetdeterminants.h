@@ -24,6 +24,7 @@
 #include <list>
 #include <tuple>
 #include <map>
+#include <limits>
 
 using namespace std;
 using namespace Eigen;
@@ -34,6 +35,12 @@ class twoInt;
 class twoIntHeatBath;
 class twoIntHeatBathSHM;
 class schedule;
+namespace SHCImakeHamiltonian {
+  struct HamHelpers2;
+}
+namespace SHCISortMpiUtils {
+  class DeterminantSet;
+}
 
 namespace SHCIgetdeterminants {
   void getDeterminantsDeterministicPT(
@@ -43,6 +50,14 @@ namespace SHCIgetdeterminants {
           std::vector<Determinant>& dets, std::vector<CItype>& numerator, std::vector<double>& energy,
           schedule& schd, int Nmc, int nelec) ;
 
+  void getDeterminantsDeterministicPT(
+          Determinant& d, double epsilon, CItype ci1, CItype ci2,
+          oneInt& int1, twoInt& int2, twoIntHeatBathSHM& I2hb,
+          vector<int>& irreps, double coreE, double E0,
+          std::vector<Determinant>& dets, std::vector<CItype>& numerator, std::vector<double>& energy,
+          schedule& schd, int Nmc, int nelec, int* closed, int* open,
+          double Energyd) ;
+
   void getDeterminantsStochastic(
           Determinant& d, double epsilon, CItype ci1, CItype ci2,
           oneInt& int1, twoInt& int2, twoIntHeatBathSHM& I2hb,
@@ -62,7 +77,17 @@ namespace SHCIgetdeterminants {
           oneInt& int1, twoInt& int2, twoIntHeatBathSHM& I2hb,
           vector<int>& irreps, double coreE, double E0,
           std::vector<Determinant>& dets,
-          schedule& schd, int Nmc, int nelec, Determinant* SortedDets, int SortedDetsSize) ;
+          schedule& schd, int Nmc, int nelec, Determinant* SortedDets, int SortedDetsSize,
+          SHCImakeHamiltonian::HamHelpers2* helpers = NULL,
+          double screened = std::numeric_limits<double>::infinity(),
+          SHCISortMpiUtils::DeterminantSet* space = NULL) ;
+
+  void countDeterminantsVariationalApprox(
+          Determinant& d, CItype ci, const vector<double>& epsilons,
+          twoIntHeatBathSHM& I2hb, schedule& schd, int nelec,
+          double screened, vector<size_t>& counts,
+          SHCImakeHamiltonian::HamHelpers2* helpers,
+          SHCISortMpiUtils::DeterminantSet* space) ;
 
   void getDeterminantsStochastic2Epsilon(
           Determinant& d, double epsilon, double epsilonLarge, CItype ci1, CItype ci2,
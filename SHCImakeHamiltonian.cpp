@@ -71,10 +71,128 @@ void SHCImakeHamiltonian::HamHelpers2::MakeSHMHelpers() {
       SinglesFromAlphaSM, SinglesFromBetaLen, SinglesFromBetaSM);
 }  // end SHCImakeHamiltonian::HamHelpers2::MakeSHMHelpers
 
+//=============================================================================
+void SHCImakeHamiltonian::HamHelpers2::MakeSHMStrings() {
+  //-----------------------------------------------------------------------------
+  /*!
+  Put the unique alpha and beta strings on the shared memory, sorted and next
+  to their indices in AlphaMajorToBeta and BetaMajorToAlpha. Together with the
+  shared helpers this is a compact (alphaIndex, betaIndex) encoding of the
+  determinants, which "contains" uses instead of a sorted copy of the
+  determinants. The tables are kept in SortedDetsSegment, which is not needed
+  for anything else when this encoding is used.
+
+  Call it after MakeSHMHelpers, the maps are only on the rank 0.
+  */
+  //-----------------------------------------------------------------------------
+  int comm_rank = 0, comm_size = 1;
+#ifndef SERIAL
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+#endif
+
+  size_t nAlpha = AlphaN.size(), nBeta = BetaN.size();
+#ifndef SERIAL
+  MPI_Bcast(&nAlpha, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&nBeta, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+  nAlphaStrings = nAlpha;
+  nBetaStrings = nBeta;
+  size_t totalMemory = (nAlpha + nBeta) * (sizeof(HalfDet) + sizeof(int));
+
+  SortedDetsSegment.truncate(totalMemory);
+  regionSortedDets = boost::interprocess::mapped_region{
+      SortedDetsSegment, boost::interprocess::read_write};
+  if (localrank == 0) memset(regionSortedDets.get_address(), 0., totalMemory);
+
+  AlphaStringsSM = static_cast<HalfDet*>(regionSortedDets.get_address());
+  BetaStringsSM = AlphaStringsSM + nAlpha;
+  AlphaStringIndexSM = reinterpret_cast<int*>(BetaStringsSM + nBeta);
+  BetaStringIndexSM = AlphaStringIndexSM + nAlpha;
+
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  // the maps are ordered, so the strings come out sorted
+  if (comm_rank == 0) {
+    int i = 0;
+    for (auto it = AlphaN.begin(); it != AlphaN.end(); it++, i++) {
+      AlphaStringsSM[i] = it->first;
+      AlphaStringIndexSM[i] = it->second;
+    }
+    i = 0;
+    for (auto it = BetaN.begin(); it != BetaN.end(); it++, i++) {
+      BetaStringsSM[i] = it->first;
+      BetaStringIndexSM[i] = it->second;
+    }
+  }
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  if (localrank == 0) {
+    long intdim = totalMemory;
+    long maxint =
+        26843540;  // mpi cannot transfer more than these number of doubles
+    long maxIter = intdim / maxint;
+#ifndef SERIAL
+    MPI_Barrier(shmcomm);
+
+    char* shrdMem = static_cast<char*>(regionSortedDets.get_address());
+    for (int i = 0; i < maxIter; i++) {
+      MPI_Bcast(shrdMem + i * maxint, maxint, MPI_CHAR, 0, shmcomm);
+      MPI_Barrier(shmcomm);
+    }
+
+    MPI_Bcast(shrdMem + (maxIter)*maxint, totalMemory - maxIter * maxint,
+              MPI_CHAR, 0, shmcomm);
+#endif
+  }
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+}  // end SHCImakeHamiltonian::HamHelpers2::MakeSHMStrings
+
+//=============================================================================
+bool SHCImakeHamiltonian::HamHelpers2::contains(Determinant& d) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Check if a determinant is in the space described by the helpers, using the
+  string tables made by MakeSHMStrings. With time reversal symmetry the
+  helpers also hold the spin-flipped partners, which then count as present.
+
+  :Inputs:
+
+      Determinant& d:
+          The determinant to look for
+
+  :Returns:
+
+      bool present:
+          True if d is in the space
+  */
+  //-----------------------------------------------------------------------------
+  HalfDet da = d.getAlpha(), db = d.getBeta();
+  HalfDet* alpha =
+      std::lower_bound(AlphaStringsSM, AlphaStringsSM + nAlphaStrings, da);
+  if (alpha == AlphaStringsSM + nAlphaStrings || !(*alpha == da)) return false;
+  HalfDet* beta =
+      std::lower_bound(BetaStringsSM, BetaStringsSM + nBetaStrings, db);
+  if (beta == BetaStringsSM + nBetaStrings || !(*beta == db)) return false;
+
+  // the beta indices of every alpha string are sorted
+  int ia = AlphaStringIndexSM[alpha - AlphaStringsSM];
+  int ib = BetaStringIndexSM[beta - BetaStringsSM];
+  return std::binary_search(AlphaMajorToBetaSM[ia],
+                            AlphaMajorToBetaSM[ia] + AlphaMajorToBetaLen[ia],
+                            ib);
+}  // end SHCImakeHamiltonian::HamHelpers2::contains
+
 //=============================================================================
 void SHCImakeHamiltonian::SparseHam::makeFromHelper(
     HamHelpers2& helpers2, Determinant* SHMDets, int startIndex, int endIndex,
-    int Norbs, oneInt& I1, twoInt& I2, double& coreE, bool DoRDM) {
+    int Norbs, oneInt& I1, twoInt& I2, double& coreE, bool DoRDM,
+    double* diag) {
   //-----------------------------------------------------------------------------
   /*!
   This is a wrapper for "MakeHfromSMHelpers2"
@@ -99,6 +217,9 @@ void SHCImakeHamiltonian::SparseHam::makeFromHelper(
           The core energy
       bool DoRDM:
           Triggers the calculation of orbital differences
+      double* diag:
+          Cached diagonal elements <D_k|H|D_k> (without time reversal), or
+          NULL to compute them here
   */
   //-----------------------------------------------------------------------------
   std::vector<std::vector<size_t>> orbDifference;
@@ -109,7 +230,7 @@ void SHCImakeHamiltonian::SparseHam::makeFromHelper(
       helpers2.BetaMajorToAlphaSM, helpers2.BetaMajorToDetSM,
       helpers2.SinglesFromAlphaLen, helpers2.SinglesFromAlphaSM,
       helpers2.SinglesFromBetaLen, helpers2.SinglesFromBetaSM, SHMDets,
-      startIndex, endIndex, diskio, *this, Norbs, I1, I2, coreE, DoRDM);
+      startIndex, endIndex, diskio, *this, Norbs, I1, I2, coreE, DoRDM, diag);
 }  // end SHCImakeHamiltonian::SparseHam::makeFromHelper
 
 //=============================================================================
@@ -234,7 +355,7 @@ void updateAlphaBeta(HalfDet& da, HalfDet& db, std::map<HalfDet, int>& BetaN,
     BetaMajorToDet.resize(itb->second + 1);
     SinglesFromBeta.resize(itb->second + 1);
 
-    int norbs = 64 * DetLen;
+    int norbs = HalfDet::norbs;
     std::vector<int> closedb(norbs / 2);  //, closedb(norbs);
     std::vector<int> openb(norbs / 2, 0);
     int nclosedb = db.getOpenClosed(openb, closedb);
@@ -261,7 +382,7 @@ void updateAlphaBeta(HalfDet& da, HalfDet& db, std::map<HalfDet, int>& BetaN,
     AlphaMajorToDet.resize(ita->second + 1);
     SinglesFromAlpha.resize(ita->second + 1);
 
-    int norbs = 64 * DetLen;
+    int norbs = HalfDet::norbs;
     std::vector<int> closeda(norbs / 2);  //, closedb(norbs);
     std::vector<int> opena(norbs / 2, 0);
     int ncloseda = da.getOpenClosed(opena, closeda);
@@ -478,7 +599,7 @@ void SHCImakeHamiltonian::MakeHfromSMHelpers2(
     int*& SinglesFromAlphaLen, vector<int*>& SinglesFromAlpha,
     int*& SinglesFromBetaLen, vector<int*>& SinglesFromBeta, Determinant* Dets,
     int StartIndex, int EndIndex, bool diskio, SparseHam& sparseHam, int Norbs,
-    oneInt& I1, twoInt& I2, double& coreE, bool DoRDM) {
+    oneInt& I1, twoInt& I2, double& coreE, bool DoRDM, double* diag) {
   //-----------------------------------------------------------------------------
   /*!
   Make the sparse Hamiltonian "sparseHam" from the Helpers
@@ -537,7 +658,7 @@ void SHCImakeHamiltonian::MakeHfromSMHelpers2(
   for (size_t k = StartIndex; k < EndIndex; k++) {
     if (k % (nprocs) != proc || k < max(StartIndex, offSet)) continue;
     connections.push_back(vector<int>(1, k));
-    CItype hij = Dets[k].Energy(I1, I2, coreE);
+    CItype hij = diag != NULL ? diag[k] : Dets[k].Energy(I1, I2, coreE);
     size_t orbDiff;
     if (Determinant::Trev != 0)
       updateHijForTReversal(hij, Dets[k], Dets[k], I1, I2, coreE, orbDiff);
@@ -660,10 +781,14 @@ void SHCImakeHamiltonian::MakeHfromSMHelpers2(
 
         Determinant di = Dets[std::abs(DetI) - 1];
         if (DetJ < 0) di.flipAlphaBeta();
-        if (Dets[std::abs(DetJ) - 1].ExcitationDistance(di) == 2) {
-          size_t orbDiff;
-          CItype hij = Hij(Dets[std::abs(DetJ) - 1], Dets[std::abs(DetI) - 1],
-                           I1, I2, coreE, orbDiff);
+        Excitation ex;
+        getExcitation(Dets[std::abs(DetJ) - 1], di, ex);
+        if (ex.level == 2) {
+          size_t orbDiff = ex.orbDiff;
+          CItype hij = DetJ > 0 ? Hij(di, ex, I1, I2)
+                                : Hij(Dets[std::abs(DetJ) - 1],
+                                      Dets[std::abs(DetI) - 1], I1, I2, coreE,
+                                      orbDiff);
           fixForTreversal(Dets, DetI, DetJ, I1, I2, coreE, orbDiff, hij);
           if (abs(hij) > 1.e-10) {
             connections[(std::abs(DetI) - offSet - 1) / nprocs].push_back(
@@ -686,10 +811,14 @@ void SHCImakeHamiltonian::MakeHfromSMHelpers2(
 
         Determinant dj = Dets[std::abs(DetI) - 1];
         if (DetJ < 0) dj.flipAlphaBeta();
-        if (Dets[std::abs(DetJ) - 1].ExcitationDistance(dj) == 2) {
-          size_t orbDiff;
-          CItype hij = Hij(Dets[std::abs(DetJ) - 1], Dets[std::abs(DetI) - 1],
-                           I1, I2, coreE, orbDiff);
+        Excitation ex;
+        getExcitation(Dets[std::abs(DetJ) - 1], dj, ex);
+        if (ex.level == 2) {
+          size_t orbDiff = ex.orbDiff;
+          CItype hij = DetJ > 0 ? Hij(dj, ex, I1, I2)
+                                : Hij(Dets[std::abs(DetJ) - 1],
+                                      Dets[std::abs(DetI) - 1], I1, I2, coreE,
+                                      orbDiff);
           fixForTreversal(Dets, DetI, DetJ, I1, I2, coreE, orbDiff, hij);
           if (abs(hij) > 1.e-10) {
             connections[(std::abs(DetI) - offSet - 1) / nprocs].push_back(
@@ -64,11 +64,24 @@ struct HamHelpers2 {
   vector<int*> BetaMajorToDetSM;
   vector<int*> SinglesFromBetaSM;
 
+  // Sorted alpha and beta strings with their index in the lists above, only
+  // made for the compact (alpha, beta) encoding of the determinants
+  int nAlphaStrings;
+  int nBetaStrings;
+  HalfDet* AlphaStringsSM;
+  HalfDet* BetaStringsSM;
+  int* AlphaStringIndexSM;
+  int* BetaStringIndexSM;
+
   // routines
   void PopulateHelpers(Determinant* SHMDets, int DetsSize, int startIndex);
 
   void MakeSHMHelpers();
 
+  void MakeSHMStrings();
+
+  bool contains(Determinant& d);
+
   void clear() {
     AlphaMajorToBeta.clear();
     AlphaMajorToDet.clear();
@@ -109,7 +122,8 @@ struct SparseHam {
 
   void makeFromHelper(HamHelpers2& helper2, Determinant* SHMDets,
                       int startIndex, int endIndex, int Norbs, oneInt& I1,
-                      twoInt& I2, double& coreE, bool DoRDM);
+                      twoInt& I2, double& coreE, bool DoRDM,
+                      double* diag = NULL);
 
   void writeBatch(int batch);
 
@@ -150,7 +164,7 @@ void MakeHfromSMHelpers2(
     int*& SinglesFromAlphaLen, vector<int*>& SinglesFromAlpha,
     int*& SinglesFromBetaLen, vector<int*>& SinglesFromBeta, Determinant* Dets,
     int StartIndex, int EndIndex, bool diskio, SparseHam& sparseHam, int Norbs,
-    oneInt& I1, twoInt& I2, double& coreE, bool DoRDM);
+    oneInt& I1, twoInt& I2, double& coreE, bool DoRDM, double* diag = NULL);
 
 void MakeSMHelpers(
     vector<vector<int>>& AlphaMajorToBeta, vector<vector<int>>& AlphaMajorToDet,
@@ -435,7 +435,7 @@ void SHCImakeHamiltonian::PopulateHelperLists(std::map<HalfDet, std::vector<int>
     
     BetaN[db].push_back(i);
 
-    int norbs = 64*DetLen;
+    int norbs = 128*HalfDetLen;
     std::vector<int> closeda(norbs/2);//, closedb(norbs);
     int ncloseda = da.getClosed(closeda);
     //int nclosedb = db.getClosed(closedb);
@@ -168,18 +168,16 @@ void SHCIrdm::makeRDM(int *&AlphaMajorToBetaLen,
 
           if (std::abs(DetJ) >= std::abs(DetI))
             continue;
-          Determinant dj = Dets[abs(DetJ) - 1];
-          size_t orbDiff;
-          getOrbDiff(dj, di, orbDiff);
-          int d0 = orbDiff % norbs, c0 = (orbDiff / norbs) % norbs;
+          Excitation ex;
+          getExcitation(Dets[abs(DetJ) - 1], di, ex);
+          int d0 = ex.des[0], c0 = ex.cre[0];
 
           for (int n1 = 0; n1 < nelec; n1++) {
-            double sgn = 1.0;
+            double sgn = ex.sgn;
             int a = max(closed[n1], c0), b = min(closed[n1], c0),
                 I = max(closed[n1], d0), J = min(closed[n1], d0);
             if (closed[n1] == d0)
               continue;
-            di.parity(min(d0, c0), max(d0, c0), sgn);
             if (!((closed[n1] > c0 && closed[n1] > d0) ||
                   (closed[n1] < c0 && closed[n1] < d0)))
               sgn *= -1.;
@@ -223,18 +221,11 @@ void SHCIrdm::makeRDM(int *&AlphaMajorToBetaLen,
             // max(offSet, StartIndex)) continue;
             if (std::abs(DetJ) >= std::abs(DetI))
               continue;
-            Determinant dj = Dets[abs(DetJ) - 1];
-            size_t orbDiff;
-            getOrbDiff(dj, di, orbDiff);
-            // CItype hij = Hij(Dets[std::abs(DetJ)], Dets[std::abs(DetI)], I1,
-            // I2, coreE, orbDiff);
-
-            int d0 = orbDiff % norbs, c0 = (orbDiff / norbs) % norbs;
-            int d1 = (orbDiff / norbs / norbs) % norbs,
-                c1 = (orbDiff / norbs / norbs / norbs) % norbs;
-            double sgn = 1.0;
-
-            di.parity(d1, d0, c1, c0, sgn);
+            Excitation ex;
+            getExcitation(Dets[abs(DetJ) - 1], di, ex);
+            int d0 = ex.des[0], c0 = ex.cre[0];
+            int d1 = ex.des[1], c1 = ex.cre[1];
+            double sgn = ex.sgn;
             populateSpatialRDM(c1, c0, d1, d0, s2RDM,
                                sgn * localConj::conj(cibra[abs(DetJ) - 1]) *
                                    ciket[abs(DetI) - 1],
@@ -260,21 +251,16 @@ void SHCIrdm::makeRDM(int *&AlphaMajorToBetaLen,
           int DetJ = AlphaMajorToDet[Astring][index];
           if (std::abs(DetJ) >= std::abs(DetI))
             continue;
-          Determinant dj = Dets[abs(DetJ) - 1];
-
-          size_t orbDiff;
-          getOrbDiff(dj, di, orbDiff);
-          // CItype hij = Hij(Dets[std::abs(DetJ)], Dets[std::abs(DetI)], I1,
-          // I2, coreE, orbDiff);
-          int d0 = orbDiff % norbs, c0 = (orbDiff / norbs) % norbs;
+          Excitation ex;
+          getExcitation(Dets[abs(DetJ) - 1], di, ex);
+          int d0 = ex.des[0], c0 = ex.cre[0];
 
           for (int n1 = 0; n1 < nelec; n1++) {
-            double sgn = 1.0;
+            double sgn = ex.sgn;
             int a = max(closed[n1], c0), b = min(closed[n1], c0),
                 I = max(closed[n1], d0), J = min(closed[n1], d0);
             if (closed[n1] == d0)
               continue;
-            di.parity(min(d0, c0), max(d0, c0), sgn);
             if (!((closed[n1] > c0 && closed[n1] > d0) ||
                   (closed[n1] < c0 && closed[n1] < d0)))
               sgn *= -1.;
@@ -298,19 +284,12 @@ void SHCIrdm::makeRDM(int *&AlphaMajorToBetaLen,
         // max(offSet, StartIndex)) continue;
         if (std::abs(DetJ) >= std::abs(DetI))
           continue;
-        Determinant dj = Dets[abs(DetJ) - 1];
-
-        if (dj.ExcitationDistance(di) == 2) {
-          size_t orbDiff;
-          getOrbDiff(dj, di, orbDiff);
-          // CItype hij = Hij(Dets[std::abs(DetJ)], Dets[std::abs(DetI)], I1,
-          // I2, coreE, orbDiff);
-          int d0 = orbDiff % norbs, c0 = (orbDiff / norbs) % norbs;
-          int d1 = (orbDiff / norbs / norbs) % norbs,
-              c1 = (orbDiff / norbs / norbs / norbs) % norbs;
-          double sgn = 1.0;
-
-          di.parity(d1, d0, c1, c0, sgn);
+        Excitation ex;
+        getExcitation(Dets[abs(DetJ) - 1], di, ex);
+        if (ex.level == 2) {
+          int d0 = ex.des[0], c0 = ex.cre[0];
+          int d1 = ex.des[1], c1 = ex.cre[1];
+          double sgn = ex.sgn;
           populateSpatialRDM(c1, c0, d1, d0, s2RDM,
                              sgn * localConj::conj(cibra[abs(DetJ) - 1]) *
                                  ciket[abs(DetI) - 1],
@@ -331,18 +310,12 @@ void SHCIrdm::makeRDM(int *&AlphaMajorToBetaLen,
         if (std::abs(DetJ) >= std::abs(DetI))
           continue;
 
-        Determinant dj = Dets[abs(DetJ) - 1];
-        if (di.ExcitationDistance(dj) == 2) {
-          size_t orbDiff;
-          getOrbDiff(dj, di, orbDiff);
-          // CItype hij = Hij(Dets[std::abs(DetJ)], Dets[std::abs(DetI)], I1,
-          // I2, coreE, orbDiff);
-          int d0 = orbDiff % norbs, c0 = (orbDiff / norbs) % norbs;
-          int d1 = (orbDiff / norbs / norbs) % norbs,
-              c1 = (orbDiff / norbs / norbs / norbs) % norbs;
-          double sgn = 1.0;
-
-          di.parity(d1, d0, c1, c0, sgn);
+        Excitation ex;
+        getExcitation(Dets[abs(DetJ) - 1], di, ex);
+        if (ex.level == 2) {
+          int d0 = ex.des[0], c0 = ex.cre[0];
+          int d1 = ex.des[1], c1 = ex.cre[1];
+          double sgn = ex.sgn;
           populateSpatialRDM(c1, c0, d1, d0, s2RDM,
                              sgn * localConj::conj(cibra[abs(DetJ) - 1]) *
                                  ciket[abs(DetI) - 1],
@@ -889,13 +862,16 @@ void SHCIrdm::EvaluateRDM(vector<vector<int>> &connections, Determinant *Dets,
   size_t norbs = Dets[0].norbs;
   int nSpatOrbs = norbs / 2;
 
-  for (int i = 0; i < DetsSize; i++) {
-    if (i % commsize != commrank)
-      continue;
-
-    vector<int> closed(nelec, 0);
-    vector<int> open(norbs - nelec, 0);
-    Dets[i].getOpenClosed(open, closed);
+  // the determinants of this rank are decoded a block at a time
+  OpenClosedBlock block;
+  const int blockSize = 256;
+  for (int i = commrank; i < DetsSize; i += commsize) {
+    int k = (i / commsize) % blockSize;
+    if (k == 0)
+      block.decode(&Dets[i],
+                   min(blockSize, (DetsSize - i + commsize - 1) / commsize),
+                   nelec, commsize);
+    int *closed = block.getClosed(k);
 
     //<Di| Gamma |Di>
     for (int n1 = 0; n1 < nelec; n1++)
@@ -50,6 +50,12 @@ std::string shciDavidson;
 boost::interprocess::shared_memory_object cMaxSegment;
 boost::interprocess::mapped_region regioncMax;
 std::string shcicMax;
+boost::interprocess::shared_memory_object DiagSegment;
+boost::interprocess::mapped_region regionDiag;
+std::string shciDiag;
+boost::interprocess::shared_memory_object DetsSetSegment;
+boost::interprocess::mapped_region regionDetsSet;
+std::string shciDetsSet;
 #ifndef SERIAL
 MPI_Comm shmcomm, localcomm;
 #endif
@@ -117,6 +123,8 @@ void initSHM() {
   shciSortedDets = "SHCISortedDetsshm" + to_string(static_cast<long long>(time(NULL) % 1000000));
   shciDavidson = "SHCIDavidsonshm" + to_string(static_cast<long long>(time(NULL) % 1000000));
   shcicMax = "SHCIcMaxshm" + to_string(static_cast<long long>(time(NULL) % 1000000));
+  shciDiag = "SHCIDiagshm" + to_string(static_cast<long long>(time(NULL) % 1000000));
+  shciDetsSet = "SHCIDetsSetshm" + to_string(static_cast<long long>(time(NULL) % 1000000));
   int2Segment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciint2.c_str(), boost::interprocess::read_write);
   int2SHMSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciint2shm.c_str(), boost::interprocess::read_write);
   hHelpersSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciHelper.c_str(), boost::interprocess::read_write);
@@ -124,6 +132,8 @@ void initSHM() {
   SortedDetsSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciSortedDets.c_str(), boost::interprocess::read_write);
   DavidsonSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciDavidson.c_str(), boost::interprocess::read_write);
   cMaxSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shcicMax.c_str(), boost::interprocess::read_write);
+  DiagSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciDiag.c_str(), boost::interprocess::read_write);
+  DetsSetSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_or_create, shciDetsSet.c_str(), boost::interprocess::read_write);
 
 }
 
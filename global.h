@@ -29,7 +29,15 @@
 #endif
 
 typedef unsigned short ushort;
-const int DetLen = 6;
+// Number of 64 bit words in a Determinant (each word holds 32 spatial orbitals)
+// and in a HalfDet. Set at compile time with -DDETLEN=n, see DETLEN in the
+// Makefile; the smallest value that fits the active space saves memory and
+// bandwidth in every determinant array.
+#ifndef DETLEN
+#define DETLEN 6
+#endif
+const int DetLen = DETLEN;
+const int HalfDetLen = (DetLen + 1) / 2;
 extern double startofCalc;
 double getTime();
 
@@ -69,6 +77,14 @@ extern boost::interprocess::shared_memory_object cMaxSegment;
 extern boost::interprocess::mapped_region regioncMax;
 extern std::string shcicMax;
 
+extern boost::interprocess::shared_memory_object DiagSegment;
+extern boost::interprocess::mapped_region regionDiag;
+extern std::string shciDiag;
+
+extern boost::interprocess::shared_memory_object DetsSetSegment;
+extern boost::interprocess::mapped_region regionDetsSet;
+extern std::string shciDetsSet;
+
 #ifndef SERIAL
 extern MPI_Comm shmcomm, localcomm;
 #endif
@@ -100,6 +100,11 @@ void readInput(string input, std::vector<std::vector<int> >& occupied, schedule&
   schd.DoOneRDM = false;
   schd.DoThreeRDM = false;
   schd.DoFourRDM = false;
+  schd.compactDets = false;
+  schd.DetHash = LEXICALHASH;
+  schd.integralCache = "";
+  schd.memoryBudget = 0.;
+  schd.growthFactor = 3.;
 
   while (dump.good()) {
 
@@ -163,6 +168,29 @@ void readInput(string input, std::vector<std::vector<int> >& occupied, schedule&
       schd.DavidsonType = DIRECT;
     else if (boost::iequals(ArgName, "diskdavidson"))
       schd.DavidsonType = DISK;
+    else if (boost::iequals(ArgName, "compactdets"))
+      schd.compactDets = true;
+    else if (boost::iequals(ArgName, "dethash")) {
+      if (boost::iequals(tok[1], "mix"))
+        schd.DetHash = MIXHASH;
+      else if (boost::iequals(tok[1], "lexical"))
+        schd.DetHash = LEXICALHASH;
+      else {
+        cout << "dethash should be either lexical or mix." << endl;
+        exit(0);
+      }
+    }
+    else if (boost::iequals(ArgName, "integralcache"))
+      schd.integralCache = tok[1];
+    else if (boost::iequals(ArgName, "memorybudget"))
+      schd.memoryBudget = atof(tok[1].c_str());
+    else if (boost::iequals(ArgName, "growthfactor")) {
+      schd.growthFactor = atof(tok[1].c_str());
+      if (schd.growthFactor <= 1.) {
+        cout << "growthfactor should be larger than 1." << endl;
+        exit(0);
+      }
+    }
     else if (boost::iequals(ArgName, "relaxedRDM"))
       schd.RdmType = UNRELAXED;
     else if (boost::iequals(ArgName, "num_thrds"))
@@ -91,7 +91,12 @@ private:
     & DoSpinOneRDM                            \
     & DoOneRDM                                \
     & DoThreeRDM                              \
-    & DoFourRDM;
+    & DoFourRDM                               \
+    & compactDets                             \
+    & DetHash                                 \
+    & integralCache                           \
+    & memoryBudget                            \
+    & growthFactor;
   }
 
 public:
@@ -153,6 +158,11 @@ public:
   bool DoOneRDM;
   bool DoThreeRDM;
   bool DoFourRDM;
+  bool compactDets;
+  hashType DetHash;
+  string integralCache;
+  double memoryBudget;   //GB per node, 0 keeps the epsilon1 schedule
+  double growthFactor;
 };
 
 #endif
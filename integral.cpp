@@ -24,6 +24,10 @@
 #include <boost/serialization/vector.hpp>
 #include "string.h"
 #include <algorithm>
+#include <boost/interprocess/file_mapping.hpp>
+#include <omp.h>
+#include <unistd.h>
+#include <cstdio>
 #ifndef SERIAL
 #include <boost/mpi.hpp>
 #include <boost/mpi/communicator.hpp>
@@ -36,14 +40,508 @@ using namespace boost;
 
 bool myfn(double i, double j) { return fabs(i)<fabs(j); }
 
+// Header of the binary integral file, followed by irrep (int[norbs]),
+// I1 (double[2norbs*2norbs]) and the twoInt store (double[I2memory]), which
+// holds the packed integrals, or the Cholesky vectors if nchol > 0.
+// The checksum covers everything after the header.
+static const char binaryIntegralMagic[8] = {'D','I','C','E','I','N','T','\0'};
+static const int binaryIntegralVersion = 2;
+struct binaryIntegralHeader {
+  char magic[8];
+  int version;
+  int norbs;
+  int nelec;
+  int ksym;
+  int nchol;
+  int unused;
+  size_t I2memory;
+  double coreE;
+  double maxEntry;
+  size_t checksum;
+};
+
+// Header of the heat bath cache written by twoIntHeatBathSHM::writeCache,
+// followed by Singles (double[2norbs*2norbs]) and the int2SHMSegment. The
+// checksum covers everything after the header.
+static const char heatBathCacheMagic[8] = {'D','I','C','E','H','B','\0','\0'};
+static const int heatBathCacheVersion = 2;
+struct heatBathCacheHeader {
+  char magic[8];
+  int version;
+  int norbs;
+  double epsilon;
+  size_t nonZeroSameSpinIntegrals;
+  size_t nonZeroOppositeSpinIntegrals;
+  size_t memRequired;
+  size_t checksum;
+};
+
+// FNV style checksum over the 8 byte words of data, h is the running value
+static size_t integralChecksum(const char *data, size_t bytes, size_t h) {
+  size_t nwords = bytes / 8;
+  for (size_t i = 0; i < nwords; i++) {
+    size_t word;
+    memcpy(&word, data + 8 * i, 8);
+    h = (h ^ word) * 0x100000001B3ULL;
+  }
+  for (size_t i = 8 * nwords; i < bytes; i++)
+    h = (h ^ (unsigned char)data[i]) * 0x100000001B3ULL;
+  return h;
+}
+
+static size_t twoIntMemory(int norbs, bool ksym, int nchol) {
+  size_t npair = ksym ? norbs * norbs : norbs * (norbs + 1) / 2;
+  if (nchol != 0) return npair * nchol;
+  return npair * (npair + 1) / 2;
+}
+
+//=============================================================================
+bool isBinaryIntegralFile(string fcidump) {
+//-----------------------------------------------------------------------------
+  /*!
+  Checks whether the integral file was written by writeIntegralsBinary
+
+  :Inputs:
+
+      string fcidump:
+          Name of the integral file
+  */
+//-----------------------------------------------------------------------------
+  ifstream dump(fcidump.c_str(), ios::binary);
+  char magic[8] = {0};
+  dump.read(magic, 8);
+  return dump.good() && memcmp(magic, binaryIntegralMagic, 8) == 0;
+}
+
+//=============================================================================
+string integralCacheName(string fcidump, string directory, double epsilon) {
+//-----------------------------------------------------------------------------
+  /*!
+  Name (without extension) of the cache files of an integral file, made from
+  a hash of its content, the heat bath threshold and the versions of the
+  cache formats, so that a cache that does not apply is never found
+
+  :Inputs:
+
+      string fcidump:
+          Name of the integral file
+      string directory:
+          Directory of the cache
+      double epsilon:
+          Threshold of the heat bath integrals
+
+  :Returns:
+
+      string name:
+          directory/dice_<hash>, or "" if the integral file does not exist
+  */
+//-----------------------------------------------------------------------------
+  size_t key = 0;
+  int exists = 0;
+  if (commrank == 0) {
+    exists = ifstream(fcidump.c_str()).good();
+    if (exists) {
+      boost::interprocess::file_mapping file(fcidump.c_str(),
+                                             boost::interprocess::read_only);
+      boost::interprocess::mapped_region region(file,
+                                                boost::interprocess::read_only);
+      key = integralChecksum(static_cast<const char *>(region.get_address()),
+                             region.get_size(), 0xCBF29CE484222325ULL);
+      int versions[2] = {binaryIntegralVersion, heatBathCacheVersion};
+      key = integralChecksum(reinterpret_cast<const char *>(&epsilon),
+                             sizeof(double), key);
+      key = integralChecksum(reinterpret_cast<const char *>(versions),
+                             sizeof(versions), key);
+    }
+  }
+#ifndef SERIAL
+  MPI_Bcast(&exists, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&key, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+#endif
+  if (!exists) return "";
+  return directory + "/dice_" + str(boost::format("%016x") % key);
+} // end integralCacheName
+
+//=============================================================================
+bool writeIntegralsBinary(string file, twoInt &I2, oneInt &I1, int nelec,
+                          int norbs, double coreE, std::vector<int> &irrep) {
+//-----------------------------------------------------------------------------
+  /*!
+  Write the integrals in the binary format read by readIntegrals, only called
+  on rank 0 (see the fcidump2bin converter)
+
+  :Inputs:
+
+      string file:
+          Name of the binary integral file
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian
+      int nelec:
+          Number of electrons
+      int norbs:
+          Number of orbitals
+      double coreE:
+          The core energy
+      std::vector<int>& irrep:
+          Irrep of the orbitals
+
+  :Returns:
+
+      bool written:
+          False if the file could not be written
+  */
+//-----------------------------------------------------------------------------
+  binaryIntegralHeader header;
+  memcpy(header.magic, binaryIntegralMagic, 8);
+  header.version = binaryIntegralVersion;
+  header.norbs = norbs;
+  header.nelec = nelec;
+  header.ksym = I2.ksym;
+  header.nchol = I2.nchol;
+  header.unused = 0;
+  header.I2memory = twoIntMemory(norbs, I2.ksym, I2.nchol);
+  header.coreE = coreE;
+  header.maxEntry = I2.maxEntry;
+
+  // irrep and I1 are written as one block, I1 is real in the complex build too
+  vector<char> small(norbs * sizeof(int) + I1.store.size() * sizeof(double));
+  memcpy(&small[0], &irrep[0], norbs * sizeof(int));
+  for (size_t i = 0; i < I1.store.size(); i++) {
+#ifndef Complex
+    double integral = I1.store[i];
+#else
+    double integral = I1.store[i].real();
+#endif
+    memcpy(&small[norbs * sizeof(int) + i * sizeof(double)], &integral,
+           sizeof(double));
+  }
+  // the file always holds the twoInt store in double precision
+#ifndef FLOAT_INTEGRALS
+  const char *I2data = reinterpret_cast<const char *>(I2.store);
+#else
+  vector<double> I2double(I2.store, I2.store + header.I2memory);
+  const char *I2data = reinterpret_cast<const char *>(&I2double[0]);
+#endif
+  header.checksum = integralChecksum(&small[0], small.size(), 0xCBF29CE484222325ULL);
+  header.checksum = integralChecksum(I2data, header.I2memory * sizeof(double),
+                                     header.checksum);
+
+  // written under a temporary name and renamed, so that a partial file is
+  // never seen (e.g. by another run sharing the integral cache)
+  string tmpFile = file + ".tmp" + to_string(static_cast<long long>(getpid()));
+  ofstream out(tmpFile.c_str(), ios::binary);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(&small[0], small.size());
+  out.write(I2data, header.I2memory * sizeof(double));
+  out.close();
+  if (!out.good() || std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+    cout << "Could not write the integral file " << file << endl;
+    std::remove(tmpFile.c_str());
+    return false;
+  }
+  return true;
+} // end writeIntegralsBinary
+
+//=============================================================================
+int choleskyVectors(twoInt &I2, double threshold, std::vector<int2Type> &L) {
+//-----------------------------------------------------------------------------
+  /*!
+  Pivoted (incomplete) Cholesky decomposition of the packed integrals of I2,
+  seen as the matrix V(ij,kl) = (ij|kl) of the npair orbital pairs. Vectors
+  are added for the pair with the largest remaining diagonal until it is
+  below the threshold, so the integrals made from the vectors have errors of
+  about the threshold. Each vector is one column of V and the update is done
+  on the OpenMP threads.
+
+  :Inputs:
+
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian, with the packed integrals
+      double threshold:
+          Largest remaining diagonal (ij|ij) that is not decomposed
+      std::vector<int2Type>& L:
+          The vectors, L(ij,P) at L[ij*nchol+P] (output)
+
+  :Returns:
+
+      int nchol:
+          The number of vectors
+  */
+//-----------------------------------------------------------------------------
+  size_t npair = I2.norbs * (I2.norbs + 1) / 2;
+  vector<double> diagonal(npair);
+  for (size_t ij = 0; ij < npair; ij++) diagonal[ij] = I2.pair(ij, ij);
+
+  // vectors[P] is the column of vector P over all pairs
+  vector<vector<double>> vectors;
+  while (vectors.size() < npair) {
+    size_t pivot =
+        std::max_element(diagonal.begin(), diagonal.end()) - diagonal.begin();
+    if (diagonal[pivot] <= threshold) break;
+    double scale = 1. / sqrt(diagonal[pivot]);
+    vector<double> column(npair);
+#pragma omp parallel for schedule(static)
+    for (long ij = 0; ij < npair; ij++) {
+      double integral = I2.pair(ij, pivot);
+      for (size_t P = 0; P < vectors.size(); P++)
+        integral -= vectors[P][ij] * vectors[P][pivot];
+      column[ij] = integral * scale;
+      diagonal[ij] -= column[ij] * column[ij];
+    }
+    diagonal[pivot] = 0.0;
+    vectors.push_back(column);
+  }
+
+  int nchol = vectors.size();
+  L.resize(npair * nchol);
+  for (size_t ij = 0; ij < npair; ij++)
+    for (int P = 0; P < nchol; P++) L[ij * nchol + P] = vectors[P][ij];
+  return nchol;
+} // end choleskyVectors
+
+//=============================================================================
+static void readIntegralsBinary(string fcidump, twoInt &I2, oneInt &I1,
+                                int &nelec, int &norbs, double &coreE,
+                                std::vector<int> &irrep) {
+//-----------------------------------------------------------------------------
+  /*!
+  Read the binary integral file written by writeIntegralsBinary. Every rank
+  maps the file and takes the header, irrep and I1 from it, the node leaders
+  copy the packed twoInt store straight into the shared int2Segment and verify
+  the checksum, so nothing is parsed or broadcast.
+
+  :Inputs:
+
+      Same as readIntegrals
+  */
+//-----------------------------------------------------------------------------
+  boost::interprocess::file_mapping file(fcidump.c_str(),
+                                         boost::interprocess::read_only);
+  boost::interprocess::mapped_region region(file,
+                                            boost::interprocess::read_only);
+  const char *data = static_cast<const char *>(region.get_address());
+
+  binaryIntegralHeader header;
+  if (region.get_size() < sizeof(header)) {
+    pout << "Integral file " << fcidump << " is truncated" << endl;
+    exit(0);
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.version != binaryIntegralVersion) {
+    pout << "Integral file " << fcidump << " has version " << header.version
+         << ", expected " << binaryIntegralVersion << endl;
+    exit(0);
+  }
+  norbs = header.norbs;
+  nelec = header.nelec;
+  coreE = header.coreE;
+  I2.ksym = header.ksym;
+  I2.nchol = header.nchol;
+  I2.norbs = norbs;
+  I2.initPairIndex();
+  size_t I2memory = twoIntMemory(norbs, I2.ksym, I2.nchol);
+  size_t smallSize = norbs * sizeof(int) + 4 * norbs * norbs * sizeof(double);
+  if (header.I2memory != I2memory ||
+      region.get_size() != sizeof(header) + smallSize + I2memory * sizeof(double)) {
+    pout << "Integral file " << fcidump << " is truncated" << endl;
+    exit(0);
+  }
+
+  const char *smallData = data + sizeof(header);
+  const char *I2data = smallData + smallSize;
+  irrep.resize(norbs);
+  memcpy(&irrep[0], smallData, norbs * sizeof(int));
+  I1.store.clear();
+  I1.store.resize(2 * norbs * (2 * norbs), 0.0);
+  I1.norbs = 2 * norbs;
+  for (size_t i = 0; i < I1.store.size(); i++) {
+    double integral;
+    memcpy(&integral, smallData + norbs * sizeof(int) + i * sizeof(double),
+           sizeof(double));
+    I1.store[i] = integral;
+  }
+
+  int2Segment.truncate((I2memory) * sizeof(int2Type));
+  regionInt2 = boost::interprocess::mapped_region{
+      int2Segment, boost::interprocess::read_write};
+  I2.store = static_cast<int2Type *>(regionInt2.get_address());
+
+  int corrupt = 0;
+  if (localrank == 0) {
+#ifndef FLOAT_INTEGRALS
+    memcpy(I2.store, I2data, I2memory * sizeof(double));
+#else
+    for (size_t i = 0; i < I2memory; i++) {
+      double integral;
+      memcpy(&integral, I2data + i * sizeof(double), sizeof(double));
+      I2.store[i] = integral;
+    }
+#endif
+    size_t checksum =
+        integralChecksum(smallData, smallSize, 0xCBF29CE484222325ULL);
+    checksum = integralChecksum(I2data, I2memory * sizeof(double), checksum);
+    corrupt = checksum != header.checksum;
+  }
+#ifndef SERIAL
+  MPI_Allreduce(MPI_IN_PLACE, &corrupt, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+  if (corrupt) {
+    pout << "The checksum of the integral file " << fcidump
+         << " does not match" << endl;
+    exit(0);
+  }
+  if (I2.nchol != 0)
+    pout << "The two electron integrals are made from " << I2.nchol
+         << " Cholesky vectors" << endl;
+
+  I2.maxEntry = header.maxEntry;
+  I2.Direct = MatrixXd::Zero(norbs, norbs);
+  I2.Exchange = MatrixXd::Zero(norbs, norbs);
+  for (int i = 0; i < norbs; i++)
+    for (int j = 0; j < norbs; j++) {
+      I2.Direct(i, j) = I2(2 * i, 2 * i, 2 * j, 2 * j);
+      I2.Exchange(i, j) = I2(2 * i, 2 * j, 2 * j, 2 * i);
+    }
+} // end readIntegralsBinary
+
+//=============================================================================
+static void parseIntegralLines(const char *begin, const char *end, twoInt &I2,
+                               oneInt &I1, double &coreE, bool &foundCoreE) {
+//-----------------------------------------------------------------------------
+  /*!
+  Parse the integral lines of an FCIDUMP body in [begin, end), begin is at the
+  start of a line. Like the line by line reader, lines that do not have five
+  fields separated by ", \t" are skipped. The fields are converted in place,
+  without building strings.
+
+  :Inputs:
+
+      const char* begin, end:
+          The byte range of the file to parse
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian (output)
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian (output)
+      double& coreE:
+          The core energy (output, only if found)
+      bool& foundCoreE:
+          Whether the core energy was in the range (output)
+  */
+//-----------------------------------------------------------------------------
+  const char *line = begin;
+  while (line < end) {
+    const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+    if (eol == NULL) eol = end;
+
+    // the first six fields, a sixth one means that the line is not an integral
+    const char *field[6];
+    int length[6], nfield = 0;
+    const char *c = line;
+    while (c < eol && nfield < 6) {
+      while (c < eol && (*c == ' ' || *c == ',' || *c == '\t' || *c == '\r')) c++;
+      if (c == eol) break;
+      field[nfield] = c;
+      while (c < eol && !(*c == ' ' || *c == ',' || *c == '\t' || *c == '\r')) c++;
+      length[nfield] = c - field[nfield];
+      nfield++;
+    }
+    line = eol + 1;
+    if (nfield != 5) continue;
+
+    char buffer[5][64];
+    for (int f = 0; f < 5; f++) {
+      int n = min(length[f], 63);
+      memcpy(buffer[f], field[f], n);
+      buffer[f][n] = '\0';
+    }
+    double integral = atof(buffer[0]);
+    int a = atoi(buffer[1]), b = atoi(buffer[2]), c0 = atoi(buffer[3]),
+        d = atoi(buffer[4]);
+
+    if (a == b && b == c0 && c0 == d && d == 0) {
+      coreE = integral;
+      foundCoreE = true;
+    } else if (b == c0 && c0 == d && d == 0) {
+      continue; // orbital energy
+    } else if (c0 == d && d == 0) {
+      I1(2 * (a - 1), 2 * (b - 1)) = integral;         // alpha,alpha
+      I1(2 * (a - 1) + 1, 2 * (b - 1) + 1) = integral; // beta,beta
+      I1(2 * (b - 1), 2 * (a - 1)) = integral;         // alpha,alpha
+      I1(2 * (b - 1) + 1, 2 * (a - 1) + 1) = integral; // beta,beta
+    } else {
+      I2.store[I2.index(a - 1, b - 1, c0 - 1, d - 1)] = integral;
+    }
+  }
+} // end parseIntegralLines
+
+//=============================================================================
+static void parseIntegralBody(string fcidump, size_t offset, twoInt &I2,
+                              oneInt &I1, double &coreE) {
+//-----------------------------------------------------------------------------
+  /*!
+  Parse the integrals of an FCIDUMP file that follow the header on the OpenMP
+  threads. The file is mapped and split into one byte range per thread, each
+  range is moved forward to a line boundary and parsed straight into I1 and
+  the shared twoInt store. An integral that appears more than once is taken
+  from an arbitrary one of its lines, the core energy from the last one.
+
+  :Inputs:
 
+      string fcidump:
+          Name of the FCIDUMP file
+      size_t offset:
+          Position of the first line after the header
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian (output)
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian (output)
+      double& coreE:
+          The core energy (output)
+  */
+//-----------------------------------------------------------------------------
+  boost::interprocess::file_mapping file(fcidump.c_str(),
+                                         boost::interprocess::read_only);
+  boost::interprocess::mapped_region region(file,
+                                            boost::interprocess::read_only);
+  const char *data = static_cast<const char *>(region.get_address());
+  const char *body = data + min(offset, region.get_size());
+  const char *end = data + region.get_size();
+  size_t bodySize = end - body;
+
+  // a range owns the lines that start in it
+  auto lineStart = [&](const char *pos) {
+    if (pos <= body) return body;
+    if (pos >= end) return end;
+    const char *eol =
+        static_cast<const char *>(memchr(pos - 1, '\n', end - (pos - 1)));
+    return eol == NULL ? end : eol + 1;
+  };
+
+  int maxThreads = omp_get_max_threads();
+  vector<double> threadCoreE(maxThreads, 0.0);
+  vector<char> threadFoundCoreE(maxThreads, 0);
+#pragma omp parallel
+  {
+    int thread = omp_get_thread_num(), nthreads = omp_get_num_threads();
+    const char *first = lineStart(body + bodySize * thread / nthreads);
+    const char *last = lineStart(body + bodySize * (thread + 1) / nthreads);
+    bool found = false;
+    parseIntegralLines(first, last, I2, I1, threadCoreE[thread], found);
+    threadFoundCoreE[thread] = found;
+  }
+  for (int thread = 0; thread < maxThreads; thread++)
+    if (threadFoundCoreE[thread]) coreE = threadCoreE[thread];
+} // end parseIntegralBody
 
 //=============================================================================
 void readIntegrals(string fcidump, twoInt &I2, oneInt &I1, int &nelec,
                    int &norbs, double &coreE, std::vector<int> &irrep) {
 //-----------------------------------------------------------------------------
   /*!
-  Read FCIDUMP file and populate "I1, I2, coreE, nelec, norbs, irrep"
+  Read FCIDUMP file and populate "I1, I2, coreE, nelec, norbs, irrep". Files
+  written by writeIntegralsBinary are recognized and mapped instead of parsed.
 
   :Inputs:
 
@@ -71,6 +569,11 @@ void readIntegrals(string fcidump, twoInt &I2, oneInt &I1, int &nelec,
     pout << "Integral file " << fcidump << " does not exist!" << endl;
     exit(0);
   }
+  if (isBinaryIntegralFile(fcidump)) {
+    readIntegralsBinary(fcidump, I2, I1, nelec, norbs, coreE, irrep);
+    return;
+  }
+  size_t bodyOffset = 0;
 
   if (commrank == 0) {
     I2.ksym = false;
@@ -117,6 +620,7 @@ void readIntegrals(string fcidump, twoInt &I2, oneInt &I1, int &nelec,
       exit(0);
     }
     irrep.resize(norbs);
+    bodyOffset = dump.eof() ? string::npos : (size_t)dump.tellg();
   } // commrank=0
 
 #ifndef SERIAL
@@ -130,22 +634,23 @@ void readIntegrals(string fcidump, twoInt &I2, oneInt &I1, int &nelec,
   if (I2.ksym)
     npair = norbs * norbs;
   I2.norbs = norbs;
-  size_t I2memory = npair * (npair + 1) / 2; // memory in bytes
+  I2.initPairIndex();
+  size_t I2memory = npair * (npair + 1) / 2; // number of integrals
 
 #ifndef SERIAL
   world.barrier();
 #endif
 
-  int2Segment.truncate((I2memory) * sizeof(double));
+  int2Segment.truncate((I2memory) * sizeof(int2Type));
   regionInt2 = boost::interprocess::mapped_region{
       int2Segment, boost::interprocess::read_write};
-  memset(regionInt2.get_address(), 0., (I2memory) * sizeof(double));
+  memset(regionInt2.get_address(), 0., (I2memory) * sizeof(int2Type));
 
 #ifndef SERIAL
   world.barrier();
 #endif
 
-  I2.store = static_cast<double *>(regionInt2.get_address());
+  I2.store = static_cast<int2Type *>(regionInt2.get_address());
 
   if (commrank == 0) {
     I1.store.clear();
@@ -153,32 +658,7 @@ void readIntegrals(string fcidump, twoInt &I2, oneInt &I1, int &nelec,
     I1.norbs = 2 * norbs;
     coreE = 0.0;
 
-    vector<string> tok;
-    string msg;
-    while (!dump.eof()) {
-      std::getline(dump, msg);
-      trim(msg);
-      boost::split(tok, msg, is_any_of(", \t"), token_compress_on);
-      if (tok.size() != 5)
-        continue;
-
-      double integral = atof(tok[0].c_str());
-      int a = atoi(tok[1].c_str()), b = atoi(tok[2].c_str()),
-          c = atoi(tok[3].c_str()), d = atoi(tok[4].c_str());
-
-      if (a == b && b == c && c == d && d == 0) {
-        coreE = integral;
-      } else if (b == c && c == d && d == 0) {
-        continue; // orbital energy
-      } else if (c == d && d == 0) {
-        I1(2 * (a - 1), 2 * (b - 1)) = integral;         // alpha,alpha
-        I1(2 * (a - 1) + 1, 2 * (b - 1) + 1) = integral; // beta,beta
-        I1(2 * (b - 1), 2 * (a - 1)) = integral;         // alpha,alpha
-        I1(2 * (b - 1) + 1, 2 * (a - 1) + 1) = integral; // beta,beta
-      } else {
-        I2(2 * (a - 1), 2 * (b - 1), 2 * (c - 1), 2 * (d - 1)) = integral;
-      }
-    } // while
+    parseIntegralBody(fcidump, bodyOffset, I2, I1, coreE);
 
     // exit(0);
     I2.maxEntry =
@@ -295,26 +775,7 @@ void twoIntHeatBathSHM::constructClass(int norbs, twoIntHeatBath &I2) {
 #endif
 
   char *startAddress = (char *)(regionInt2SHM.get_address());
-  sameSpinIntegrals = (float *)(startAddress);
-  startingIndicesSameSpin =
-      (size_t *)(startAddress + nonZeroSameSpinIntegrals * sizeof(float));
-  sameSpinPairs =
-      (short *)(startAddress + nonZeroSameSpinIntegrals * sizeof(float) +
-                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
-  oppositeSpinIntegrals =
-      (float *)(startAddress +
-                nonZeroSameSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
-                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
-  startingIndicesOppositeSpin =
-      (size_t *)(startAddress + nonZeroOppositeSpinIntegrals * sizeof(float) +
-                 nonZeroSameSpinIntegrals *
-                     (sizeof(float) + 2 * sizeof(short)) +
-                 (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
-  oppositeSpinPairs =
-      (short *)(startAddress + nonZeroOppositeSpinIntegrals * sizeof(float) +
-                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t) +
-                nonZeroSameSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
-                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
+  setPointers(norbs, nonZeroSameSpinIntegrals, nonZeroOppositeSpinIntegrals);
 
   if (commrank == 0) {
     startingIndicesSameSpin[0] = 0;
@@ -330,9 +791,8 @@ void twoIntHeatBathSHM::constructClass(int norbs, twoIntHeatBath &I2) {
                              compAbs>::reverse_iterator it =
                    it1->second.rbegin();
                it != it1->second.rend(); it++) {
-            sameSpinIntegrals[index] = it->first;
-            sameSpinPairs[2 * index] = it->second.first;
-            sameSpinPairs[2 * index + 1] = it->second.second;
+            setEntry(sameSpinIntegrals, sameSpinPairs, sameSpinEntries, index,
+                     it->first, it->second.first, it->second.second);
             index++;
           }
         }
@@ -355,9 +815,9 @@ void twoIntHeatBathSHM::constructClass(int norbs, twoIntHeatBath &I2) {
                              compAbs>::reverse_iterator it =
                    it1->second.rbegin();
                it != it1->second.rend(); it++) {
-            oppositeSpinIntegrals[index] = it->first;
-            oppositeSpinPairs[2 * index] = it->second.first;
-            oppositeSpinPairs[2 * index + 1] = it->second.second;
+            setEntry(oppositeSpinIntegrals, oppositeSpinPairs,
+                     oppositeSpinEntries, index, it->first, it->second.first,
+                     it->second.second);
             index++;
           }
         }
@@ -387,6 +847,409 @@ void twoIntHeatBathSHM::constructClass(int norbs, twoIntHeatBath &I2) {
 #endif
 } // end twoIntHeatBathSHM::constructClass
 
+//=============================================================================
+void twoIntHeatBathSHM::setPointers(int norbs, size_t nonZeroSameSpinIntegrals,
+                                    size_t nonZeroOppositeSpinIntegrals) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Point the arrays into int2SHMSegment, which holds the same spin integrals,
+  their starting indices and orbital pairs, then the same for opposite spin.
+  With at most 256 orbitals the pairs are stored as compact entries.
+
+  :Inputs:
+
+      int norbs:
+          Number of orbitals
+      size_t nonZeroSameSpinIntegrals:
+          Number of same spin integrals
+      size_t nonZeroOppositeSpinIntegrals:
+          Number of opposite spin integrals
+  */
+//-----------------------------------------------------------------------------
+  char *startAddress = (char *)(regionInt2SHM.get_address());
+  sameSpinIntegrals = (float *)(startAddress);
+  startingIndicesSameSpin =
+      (size_t *)(startAddress + nonZeroSameSpinIntegrals * sizeof(float));
+  sameSpinPairs =
+      (short *)(startAddress + nonZeroSameSpinIntegrals * sizeof(float) +
+                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
+  oppositeSpinIntegrals =
+      (float *)(startAddress +
+                nonZeroSameSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
+                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
+  startingIndicesOppositeSpin =
+      (size_t *)(startAddress + nonZeroOppositeSpinIntegrals * sizeof(float) +
+                 nonZeroSameSpinIntegrals *
+                     (sizeof(float) + 2 * sizeof(short)) +
+                 (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
+  oppositeSpinPairs =
+      (short *)(startAddress + nonZeroOppositeSpinIntegrals * sizeof(float) +
+                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t) +
+                nonZeroSameSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
+                (norbs * (norbs + 1) / 2 + 1) * sizeof(size_t));
+  compact = norbs <= 256;
+  sameSpinEntries = (compactHeatBathEntry *)sameSpinPairs;
+  oppositeSpinEntries = (compactHeatBathEntry *)oppositeSpinPairs;
+} // end twoIntHeatBathSHM::setPointers
+
+//=============================================================================
+void twoIntHeatBathSHM::writeCache(string file, int norbs) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Write Singles and the int2SHMSegment to the heat bath cache, only called on
+  rank 0. The file is written under a temporary name and renamed, so that
+  other runs never see a partial cache.
+
+  :Inputs:
+
+      string file:
+          Name of the cache file
+      int norbs:
+          Number of orbitals
+  */
+//-----------------------------------------------------------------------------
+  size_t npair = norbs * (norbs + 1) / 2;
+  heatBathCacheHeader header;
+  memcpy(header.magic, heatBathCacheMagic, 8);
+  header.version = heatBathCacheVersion;
+  header.norbs = norbs;
+  header.epsilon = epsilon;
+  header.nonZeroSameSpinIntegrals = startingIndicesSameSpin[npair];
+  header.nonZeroOppositeSpinIntegrals = startingIndicesOppositeSpin[npair];
+  header.memRequired =
+      (header.nonZeroSameSpinIntegrals + header.nonZeroOppositeSpinIntegrals) *
+          (sizeof(float) + 2 * sizeof(short)) +
+      2 * (npair + 1) * sizeof(size_t);
+
+  const char *singles = reinterpret_cast<const char *>(Singles.data());
+  const char *segment = static_cast<const char *>(regionInt2SHM.get_address());
+  header.checksum = integralChecksum(singles, Singles.size() * sizeof(double),
+                                     0xCBF29CE484222325ULL);
+  header.checksum =
+      integralChecksum(segment, header.memRequired, header.checksum);
+
+  string tmpFile = file + ".tmp" + to_string(static_cast<long long>(getpid()));
+  ofstream out(tmpFile.c_str(), ios::binary);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(singles, Singles.size() * sizeof(double));
+  out.write(segment, header.memRequired);
+  out.close();
+  if (!out.good() || std::rename(tmpFile.c_str(), file.c_str()) != 0) {
+    cout << "Could not write the heat bath cache " << file << endl;
+    std::remove(tmpFile.c_str());
+  }
+} // end twoIntHeatBathSHM::writeCache
+
+//=============================================================================
+bool twoIntHeatBathSHM::readCache(string file, int norbs) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Read Singles and the int2SHMSegment from the heat bath cache, the node
+  leaders copy the segment from the mapped file and verify its checksum.
+  Returns false, without changing anything, if there is no cache for these
+  orbitals and threshold or it is corrupt, rank 0 decides for all ranks.
+
+  :Inputs:
+
+      string file:
+          Name of the cache file
+      int norbs:
+          Number of orbitals
+  */
+//-----------------------------------------------------------------------------
+  heatBathCacheHeader header;
+  int valid = 0;
+  if (commrank == 0) {
+    ifstream in(file.c_str(), ios::binary);
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    in.seekg(0, ios::end);
+    valid = in.good() && memcmp(header.magic, heatBathCacheMagic, 8) == 0 &&
+            header.version == heatBathCacheVersion && header.norbs == norbs &&
+            header.epsilon == epsilon &&
+            (size_t)in.tellg() == sizeof(header) +
+                                      4 * norbs * norbs * sizeof(double) +
+                                      header.memRequired;
+  }
+#ifndef SERIAL
+  MPI_Bcast(&valid, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+  if (!valid) return false;
+
+  boost::interprocess::file_mapping mapping(file.c_str(),
+                                            boost::interprocess::read_only);
+  boost::interprocess::mapped_region region(mapping,
+                                            boost::interprocess::read_only);
+  const char *data = static_cast<const char *>(region.get_address());
+  memcpy(&header, data, sizeof(header));
+  const char *singles = data + sizeof(header);
+  const char *segment = singles + 4 * norbs * norbs * sizeof(double);
+
+  int2SHMSegment.truncate(header.memRequired);
+  regionInt2SHM = boost::interprocess::mapped_region{
+      int2SHMSegment, boost::interprocess::read_write};
+  int corrupt = 0;
+  if (localrank == 0) {
+    memcpy(regionInt2SHM.get_address(), segment, header.memRequired);
+    size_t checksum = integralChecksum(
+        singles, 4 * norbs * norbs * sizeof(double), 0xCBF29CE484222325ULL);
+    checksum = integralChecksum(segment, header.memRequired, checksum);
+    corrupt = checksum != header.checksum;
+  }
+#ifndef SERIAL
+  MPI_Allreduce(MPI_IN_PLACE, &corrupt, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+#endif
+  if (corrupt) {
+    pout << "The heat bath cache " << file << " is corrupt, rebuilding it"
+         << endl;
+    return false;
+  }
+
+  Singles.resize(2 * norbs, 2 * norbs);
+  memcpy(Singles.data(), singles, 4 * norbs * norbs * sizeof(double));
+  setPointers(norbs, header.nonZeroSameSpinIntegrals,
+              header.nonZeroOppositeSpinIntegrals);
+  return true;
+} // end twoIntHeatBathSHM::readCache
+
+// an integral of the heat bath list of a pair ij, with its pair ab
+struct heatBathEntry {
+  float integral;
+  short a, b;
+};
+
+// Sorts the list by decreasing |integral|. Entries with equal |integral| end
+// up in the reverse of the order they were found in, like the reverse
+// iteration over the multimap of twoIntHeatBath.
+static void sortHeatBath(vector<heatBathEntry> &entries) {
+  std::reverse(entries.begin(), entries.end());
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const heatBathEntry &x, const heatBathEntry &y) {
+                     return fabs(x.integral) > fabs(y.integral);
+                   });
+}
+
+// rows(A,P) = L(IA,P), the Cholesky vectors of the pairs IA of the orbital I
+static void choleskyRows(const twoInt &I2, int I, MatrixXd &rows) {
+  int norbs = I2.norbs;
+  rows.resize(norbs, I2.nchol);
+  for (int A = 0; A < norbs; A++) {
+    const int2Type *L = I2.store + I2.pairIndex[I * norbs + A] * I2.nchol;
+    for (int P = 0; P < I2.nchol; P++) rows(A, P) = L[P];
+  }
+}
+
+// block(A,B) = (IA|JB) for all A and B. With Cholesky vectors this is the
+// product of the rows of I and J, which replaces norbs^2 separate sums.
+static void exchangeBlock(const twoInt &I2, int I, int J, MatrixXd &rowsI,
+                          MatrixXd &rowsJ, MatrixXd &block) {
+  int norbs = I2.norbs;
+  if (I2.nchol != 0) {
+    choleskyRows(I2, I, rowsI);
+    choleskyRows(I2, J, rowsJ);
+    block.noalias() = rowsI * rowsJ.transpose();
+    return;
+  }
+  block.resize(norbs, norbs);
+  for (int B = 0; B < norbs; B++)
+    for (int A = 0; A < norbs; A++) block(A, B) = I2.spatial(I, A, J, B);
+}
+
+//=============================================================================
+static void singlesBound(int norbs, twoInt &I2, oneInt &I1, MatrixXd &Singles) {
+  //-----------------------------------------------------------------------------
+  /*!
+  The bound on the single excitations i->a used by the heat bath selection,
+  the largest of |I1(i,a)| and |(ia|jj) - (ij|ja)| over the spin orbitals j.
+  For i and a of the same spin this is the largest over the spatial J of
+  |(IA|JJ)| (j of the other spin) and |(IA|JJ) - (IJ|JA)| (j of the same
+  spin), which is reduced over columns of (IA|JJ) and (IJ|JA) for a fixed I.
+  The rows I are split over the ranks and the OpenMP threads, and the result
+  is summed so that every rank has the whole matrix. With Cholesky vectors,
+  (IA|JJ) is made as a matrix product.
+
+  :Inputs:
+
+      int norbs:
+          Number of orbitals
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian
+      MatrixXd& Singles:
+          The bound for every pair of spin orbitals (output)
+  */
+//-----------------------------------------------------------------------------
+  Singles = MatrixXd::Zero(2 * norbs, 2 * norbs);
+  long nowned = (norbs + commsize - 1 - commrank) / commsize;
+  // with Cholesky vectors, diagonal(J,P) = L(JJ,P)
+  MatrixXd diagonal(norbs, I2.nchol);
+  for (int J = 0; J < norbs && I2.nchol != 0; J++)
+    for (int P = 0; P < I2.nchol; P++)
+      diagonal(J, P) = I2.store[I2.pairIndex[J * norbs + J] * I2.nchol + P];
+#pragma omp parallel
+  {
+    // direct(J,A) = (IA|JJ) and exchange(J,A) = (IJ|JA), contiguous in J
+    MatrixXd direct(norbs, norbs), exchange(norbs, norbs), rows;
+#pragma omp for schedule(dynamic)
+    for (long p = 0; p < nowned; p++) {
+      int I = commrank + p * commsize;
+      if (I2.nchol != 0) {
+        choleskyRows(I2, I, rows);
+        direct.noalias() = diagonal * rows.transpose();
+      }
+      for (int A = 0; A < norbs; A++)
+        for (int J = 0; J < norbs; J++) {
+          if (I2.nchol == 0) direct(J, A) = I2.spatial(I, A, J, J);
+          exchange(J, A) = I2.spatial(I, J, J, A);
+        }
+      VectorXd bound = direct.cwiseAbs()
+                           .cwiseMax((direct - exchange).cwiseAbs())
+                           .colwise()
+                           .maxCoeff()
+                           .transpose();
+      for (int A = 0; A < norbs; A++)
+        for (int si = 0; si < 2; si++)
+          for (int sa = 0; sa < 2; sa++) {
+            int i = 2 * I + si, a = 2 * A + sa;
+            double one = std::abs(I1(i, a));
+            Singles(i, a) = si == sa ? max(one, bound(A)) : one;
+          }
+    }
+  }
+#ifndef SERIAL
+  MPI_Allreduce(MPI_IN_PLACE, Singles.data(), Singles.size(), MPI_DOUBLE,
+                MPI_SUM, MPI_COMM_WORLD);
+#endif
+} // end singlesBound
+
+//=============================================================================
+void twoIntHeatBathSHM::constructClass(int norbs, twoInt &I2, oneInt &I1) {
+  //-----------------------------------------------------------------------------
+  /*!
+  Build the heat bath arrays directly from the integrals, without the maps of
+  twoIntHeatBath. The ij pairs are split over the ranks and the OpenMP threads,
+  every pair collects and sorts its own flat lists, a prefix sum of the list
+  sizes gives the starting indices, and each rank writes its lists into the
+  node's int2SHMSegment. The node leaders then combine the segments (which
+  are zero outside of the lists written on the node) with a bitwise or.
+  With Cholesky vectors, the integrals (ia|jb) of a pair are made together
+  by exchangeBlock as one matrix product. Singles is made by singlesBound.
+
+  :Inputs:
+
+      int norbs:
+          Number of orbitals
+      twoInt& I2:
+          Two-electron tensor of the Hamiltonian
+      oneInt& I1:
+          One-electron tensor of the Hamiltonian
+  */
+//-----------------------------------------------------------------------------
+  singlesBound(norbs, I2, I1, Singles);
+
+  // the lists of the pairs ij = i*(i+1)/2+j, j<=i, owned by this rank
+  size_t npair = norbs * (norbs + 1) / 2;
+  vector<short> pairI(npair), pairJ(npair);
+  for (int i = 0; i < norbs; i++)
+    for (int j = 0; j <= i; j++) {
+      pairI[i * (i + 1) / 2 + j] = i;
+      pairJ[i * (i + 1) / 2 + j] = j;
+    }
+  vector<vector<heatBathEntry>> sameSpin(npair), oppositeSpin(npair);
+  vector<size_t> counts(2 * npair, 0);
+  long nowned = (npair + commsize - 1 - commrank) / commsize;
+#pragma omp parallel
+  {
+    // block(a,b) = (ia|jb)
+    MatrixXd rowsI, rowsJ, block;
+#pragma omp for schedule(dynamic)
+    for (long p = 0; p < nowned; p++) {
+      size_t ij = commrank + p * commsize;
+      int i = pairI[ij], j = pairJ[ij];
+      exchangeBlock(I2, i, j, rowsI, rowsJ, block);
+      for (int a = 0; a < norbs; a++)
+        for (int b = 0; b < norbs; b++) {
+          double integral = block(a, b);
+          if (fabs(integral) > epsilon)
+            oppositeSpin[ij].push_back({(float)integral, (short)a, (short)b});
+          if (a >= b) {
+            integral -= block(b, a);
+            if (fabs(integral) > epsilon)
+              sameSpin[ij].push_back({(float)integral, (short)a, (short)b});
+          }
+        }
+      sortHeatBath(sameSpin[ij]);
+      sortHeatBath(oppositeSpin[ij]);
+      counts[ij] = sameSpin[ij].size();
+      counts[npair + ij] = oppositeSpin[ij].size();
+    }
+  }
+#ifndef SERIAL
+  MPI_Allreduce(MPI_IN_PLACE, &counts[0], 2 * npair, MPI_UNSIGNED_LONG, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+
+  vector<size_t> startSame(npair + 1, 0), startOpposite(npair + 1, 0);
+  for (size_t ij = 0; ij < npair; ij++) {
+    startSame[ij + 1] = startSame[ij] + counts[ij];
+    startOpposite[ij + 1] = startOpposite[ij] + counts[npair + ij];
+  }
+  size_t nonZeroSameSpinIntegrals = startSame[npair];
+  size_t nonZeroOppositeSpinIntegrals = startOpposite[npair];
+  size_t memRequired =
+      nonZeroSameSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
+      (npair + 1) * sizeof(size_t) +
+      nonZeroOppositeSpinIntegrals * (sizeof(float) + 2 * sizeof(short)) +
+      (npair + 1) * sizeof(size_t);
+
+  int2SHMSegment.truncate(memRequired);
+  regionInt2SHM = boost::interprocess::mapped_region{
+      int2SHMSegment, boost::interprocess::read_write};
+  if (localrank == 0) memset(regionInt2SHM.get_address(), 0, memRequired);
+  setPointers(norbs, nonZeroSameSpinIntegrals, nonZeroOppositeSpinIntegrals);
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  if (localrank == 0)
+    for (size_t ij = 0; ij <= npair; ij++) {
+      startingIndicesSameSpin[ij] = startSame[ij];
+      startingIndicesOppositeSpin[ij] = startOpposite[ij];
+    }
+#pragma omp parallel for schedule(dynamic)
+  for (long p = 0; p < nowned; p++) {
+    size_t ij = commrank + p * commsize;
+    for (size_t k = 0; k < sameSpin[ij].size(); k++) {
+      setEntry(sameSpinIntegrals, sameSpinPairs, sameSpinEntries,
+               startSame[ij] + k, sameSpin[ij][k].integral, sameSpin[ij][k].a,
+               sameSpin[ij][k].b);
+    }
+    for (size_t k = 0; k < oppositeSpin[ij].size(); k++) {
+      setEntry(oppositeSpinIntegrals, oppositeSpinPairs, oppositeSpinEntries,
+               startOpposite[ij] + k, oppositeSpin[ij][k].integral,
+               oppositeSpin[ij][k].a, oppositeSpin[ij][k].b);
+    }
+    vector<heatBathEntry>().swap(sameSpin[ij]);
+    vector<heatBathEntry>().swap(oppositeSpin[ij]);
+  }
+#ifndef SERIAL
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  if (localrank == 0) {
+    long maxint =
+        26843540; // mpi cannot transfer more than these number of doubles
+    long maxIter = memRequired / maxint;
+    char *shrdMem = static_cast<char *>(regionInt2SHM.get_address());
+    for (int i = 0; i < maxIter; i++)
+      MPI_Allreduce(MPI_IN_PLACE, shrdMem + i * maxint, maxint, MPI_BYTE,
+                    MPI_BOR, shmcomm);
+    MPI_Allreduce(MPI_IN_PLACE, shrdMem + maxIter * maxint,
+                  memRequired - maxIter * maxint, MPI_BYTE, MPI_BOR, shmcomm);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+} // end twoIntHeatBathSHM::constructClass
+
 #ifdef Complex
 //=============================================================================
 void readSOCIntegrals(oneInt &I1, int norbs, string fileprefix) {
@@ -649,7 +1512,12 @@ int readNorbs(string fcidump) {
   boost::mpi::communicator world;
 #endif
   int norbs;
-  if (commrank == 0) {
+  if (commrank == 0 && isBinaryIntegralFile(fcidump)) {
+    ifstream dump(fcidump.c_str(), ios::binary);
+    binaryIntegralHeader header;
+    dump.read(reinterpret_cast<char *>(&header), sizeof(header));
+    norbs = header.norbs;
+  } else if (commrank == 0) {
     ifstream dump(fcidump.c_str());
     vector<string> tok;
     string msg;
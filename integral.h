@@ -24,6 +24,7 @@
 #include <Eigen/Dense>
 #include <map>
 #include <utility>
+#include <cstring>
 #include "iowrapper.h"
 #include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/serialization/complex.hpp>
@@ -62,6 +63,14 @@ class oneInt {
 
 
 
+// The two electron integrals are stored in single precision when Dice is
+// compiled with USE_FLOAT_INTEGRALS (-DFLOAT_INTEGRALS), to halve their memory.
+#ifdef FLOAT_INTEGRALS
+typedef float int2Type;
+#else
+typedef double int2Type;
+#endif
+
 class twoInt {
   private:
     friend class boost::serialization::access;
@@ -72,32 +81,66 @@ class twoInt {
            & Exchange \
            & zero     \
            & norbs   \
-           & ksym;
+           & ksym    \
+           & nchol;
       }
 
   public:
-    double* store;
+    //(ij|kl) is stored once for ij>=kl, at store[ij*(ij+1)/2+kl], so the
+    //integrals with kl<=ij are contiguous for a fixed pair ij
+    //with nchol > 0 the store holds the Cholesky vectors of the integrals
+    //instead, L(ij,P) at store[ij*nchol+P], and (ij|kl) = sum_P L(ij,P)L(kl,P)
+    int2Type* store;
     double maxEntry;
     MatrixXd Direct, Exchange;
     double zero ;
     size_t norbs;
     bool ksym;
-    twoInt() :zero(0.0),maxEntry(100.) {}
-    inline double& operator()(int i, int j, int k, int l) {
-      zero = 0.0;
-      if (!((i%2 == j%2) && (k%2 == l%2))) return zero;
-      int I=i/2;int J=j/2;int K=k/2;int L=l/2;
-
-      if(!ksym) {
-        int IJ = max(I,J)*(max(I,J)+1)/2 + min(I,J);
-        int KL = max(K,L)*(max(K,L)+1)/2 + min(K,L);
-        int A = max(IJ,KL), B = min(IJ,KL);
-        return store[A*(A+1)/2+B];
-      } else {
-        int IJ = I*norbs+J, KL = K*norbs+L;
-        int A = max(IJ,KL), B = min(IJ,KL);
-        return store[A*(A+1)/2+B];
+    int nchol;
+    //pair index ij of the spatial orbitals i and j, at pairIndex[i*norbs+j]
+    std::vector<size_t> pairIndex;
+    twoInt() :zero(0.0),maxEntry(100.),nchol(0) {}
+
+    //has to be called once norbs and ksym are known
+    void initPairIndex() {
+      pairIndex.resize(norbs*norbs);
+      for (size_t i=0; i<norbs; i++)
+        for (size_t j=0; j<norbs; j++)
+          pairIndex[i*norbs+j] = ksym ? i*norbs+j : max(i,j)*(max(i,j)+1)/2 + min(i,j);
+    }
+
+    //position of (IJ|KL) of the spatial orbitals I, J, K, L in the store
+    inline size_t index(int I, int J, int K, int L) const {
+      size_t IJ = pairIndex[I*norbs+J], KL = pairIndex[K*norbs+L];
+      size_t A = max(IJ,KL), B = min(IJ,KL);
+      return A*(A+1)/2+B;
+    }
+
+    //(IJ|KL) of the pair indices IJ and KL
+    inline double pair(size_t IJ, size_t KL) const {
+      if (nchol != 0) {
+        //four partial sums, so that the additions are not one serial chain
+        const int2Type *x = store + IJ*nchol, *y = store + KL*nchol;
+        double sum[4] = {0.0, 0.0, 0.0, 0.0};
+        int P = 0;
+        for (; P+4<=nchol; P+=4)
+          for (int k=0; k<4; k++) sum[k] += (double)x[P+k]*y[P+k];
+        for (; P<nchol; P++) sum[0] += (double)x[P]*y[P];
+        return (sum[0]+sum[1]) + (sum[2]+sum[3]);
       }
+      size_t A = max(IJ,KL), B = min(IJ,KL);
+      return store[A*(A+1)/2+B];
+    }
+
+    //(IJ|KL) of the spatial orbitals I, J, K, L
+    inline double spatial(int I, int J, int K, int L) const {
+      return pair(pairIndex[I*norbs+J], pairIndex[K*norbs+L]);
+    }
+
+    //(ij|kl) of the spin orbitals i, j, k, l
+    inline double operator()(int i, int j, int k, int l) const {
+      if (!((i%2 == j%2) && (k%2 == l%2))) return 0.0;
+      return spatial(i/2, j/2, k/2, l/2);
     }
 };
 
@@ -153,6 +196,22 @@ class twoIntHeatBath {
     } // end constructClass
 };
 
+// An entry of the heat bath lists when there are at most 256 orbitals, which
+// takes the place of the pair of shorts. magnitude is the top 16 bits of the
+// float |integral| (its exponent and 8 mantissa bits), so the selection loops
+// can walk the entries without reading the integrals.
+struct compactHeatBathEntry {
+  unsigned short magnitude;
+  unsigned char a, b;
+};
+
+inline unsigned short heatBathMagnitude(float integral) {
+  float absolute = fabs(integral);
+  unsigned int bits;
+  memcpy(&bits, &absolute, sizeof(float));
+  return bits >> 15;
+}
+
 class twoIntHeatBathSHM {
   public:
     float* sameSpinIntegrals;
@@ -161,13 +220,55 @@ class twoIntHeatBathSHM {
     size_t* startingIndicesOppositeSpin;
     short* sameSpinPairs;
     short* oppositeSpinPairs;
+    //the same memory as the pairs, used instead of them if compact
+    compactHeatBathEntry* sameSpinEntries;
+    compactHeatBathEntry* oppositeSpinEntries;
+    bool compact;
     double* singleExcitation;
     MatrixXd Singles;
 
     double epsilon;
-    twoIntHeatBathSHM(double epsilon_) : epsilon(fabs(epsilon_)) {}
+    twoIntHeatBathSHM(double epsilon_) : epsilon(fabs(epsilon_)), compact(false) {}
 
+    //fabs(integrals[index]) < eps, where bucket = heatBathMagnitude(eps). The
+    //magnitudes of the compact entries decide this without the integral,
+    //except in the bucket of eps itself.
+    inline bool below(const float* integrals, const compactHeatBathEntry* entries,
+                      size_t index, double eps, unsigned short bucket) const {
+      if (compact && entries[index].magnitude != bucket)
+        return entries[index].magnitude < bucket;
+      return fabs(integrals[index]) < eps;
+    }
+
+    //the orbital a (k=0) or b (k=1) of the entry index
+    inline int orbital(const short* pairs, const compactHeatBathEntry* entries,
+                       size_t index, int k) const {
+      if (compact) return k == 0 ? entries[index].a : entries[index].b;
+      return pairs[2*index+k];
+    }
+
+    inline void setEntry(float* integrals, short* pairs, compactHeatBathEntry* entries,
+                         size_t index, float integral, short a, short b) {
+      integrals[index] = integral;
+      if (compact) {
+        compactHeatBathEntry entry = {heatBathMagnitude(integral), (unsigned char)a, (unsigned char)b};
+        entries[index] = entry;
+      }
+      else {
+        pairs[2*index] = a;
+        pairs[2*index+1] = b;
+      }
+    }
+
+    //from the maps of twoIntHeatBath made on rank 0
     void constructClass(int norbs, twoIntHeatBath& I2) ;
+    //directly from the integrals on all ranks
+    void constructClass(int norbs, twoInt& I2, oneInt& I1) ;
+    void setPointers(int norbs, size_t nonZeroSameSpinIntegrals,
+                     size_t nonZeroOppositeSpinIntegrals) ;
+    //heat bath cache of the integralcache keyword
+    void writeCache(string file, int norbs) ;
+    bool readCache(string file, int norbs) ;
 };
 
 
@@ -179,6 +280,18 @@ void readGTensorIntegrals(vector<oneInt>& I1soc, int norbs, string fileprefix);
 
 int readNorbs(string fcidump);
 
+bool isBinaryIntegralFile(string fcidump);
+
+int choleskyVectors(twoInt& I2, double threshold, std::vector<int2Type>& L);
+
+string integralCacheName(string fcidump, string directory, double epsilon);
+
+bool writeIntegralsBinary(
+        string file,
+        twoInt& I2, oneInt& I1,
+        int nelec, int norbs, double coreE,
+        std::vector<int>& irrep);
+
 void readIntegrals(
         string fcidump,
         twoInt& I2, oneInt& I1,